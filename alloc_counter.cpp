@@ -0,0 +1,50 @@
+#include "alloc_counter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+using namespace std;
+
+static atomic<unsigned long long> alloc_count(0);
+static atomic<unsigned long long> alloc_bytes(0);
+
+void* operator new(size_t size)
+{
+	alloc_count.fetch_add(1, memory_order_relaxed);
+	alloc_bytes.fetch_add(size, memory_order_relaxed);
+	void* p = malloc(size ? size : 1);
+	if (!p)
+		throw bad_alloc();
+	return p;
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept
+{
+	alloc_count.fetch_add(1, memory_order_relaxed);
+	alloc_bytes.fetch_add(size, memory_order_relaxed);
+	return malloc(size ? size : 1);
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, const nothrow_t&) noexcept
+{
+	free(p);
+}
+
+unsigned long long GetAllocCount()
+{
+	return alloc_count.load(memory_order_relaxed);
+}
+
+unsigned long long GetAllocBytes()
+{
+	return alloc_bytes.load(memory_order_relaxed);
+}
@@ -0,0 +1,11 @@
+#ifndef _ALLOC_COUNTER_H_
+#define _ALLOC_COUNTER_H_
+
+// Heap allocations so far, counted by the global operator new that
+// alloc_counter.cpp replaces. Link it in to count; the replacement stays
+// in its own file so that callers never see malloc and free inlined
+// against a new expression.
+unsigned long long GetAllocCount();
+unsigned long long GetAllocBytes();
+
+#endif
@@ -0,0 +1,54 @@
+#include "arena.h"
+#include <cstring>
+
+Arena::Arena(size_t block) : cur(NULL), end(NULL), block_size(block), used(0)
+{}
+
+Arena::~Arena()
+{
+	for (size_t i = 0; i < blocks.size(); ++i)
+		delete[] blocks[i];
+}
+
+void* Arena::Grow(size_t size, size_t align)
+{
+	size_t n = block_size;
+	if (size + align > n)
+		n = size + align;
+	char* block = new char[n];
+	blocks.push_back(block);
+	cur = block;
+	end = block + n;
+	return Allocate(size, align);
+}
+
+const char* Arena::Copy(const char* s, size_t len)
+{
+	char* p = (char*)Allocate(len + 1, 1);
+	memcpy(p, s, len);
+	p[len] = '\0';
+	return p;
+}
+
+// Takes over other's blocks, so that what was allocated there lives as
+// long as this arena. other is left empty.
+void Arena::Adopt(Arena& other)
+{
+	blocks.insert(blocks.end(), other.blocks.begin(), other.blocks.end());
+	used += other.used;
+	other.blocks.clear();
+	other.cur = NULL;
+	other.end = NULL;
+	other.used = 0;
+}
+
+// Releases everything allocated so far; the arena can be used again.
+void Arena::Reset()
+{
+	for (size_t i = 0; i < blocks.size(); ++i)
+		delete[] blocks[i];
+	blocks.clear();
+	cur = NULL;
+	end = NULL;
+	used = 0;
+}
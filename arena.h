@@ -0,0 +1,47 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <cstddef>
+#include <vector>
+#include <new>
+#include <utility>
+using namespace std;
+
+class Arena
+{
+private:
+	vector<char*> blocks;
+	char* cur;
+	char* end;
+	size_t block_size;
+	size_t used;
+
+	void* Grow(size_t size, size_t align);
+
+public:
+	Arena(size_t block = 64 * 1024);
+	~Arena();
+
+	void* Allocate(size_t size, size_t align = alignof(max_align_t))
+	{
+		char* p = (char*)(((size_t)cur + align - 1) & ~(align - 1));
+		if (p + size > end)
+			return Grow(size, align);
+		cur = p + size;
+		used += size;
+		return p;
+	};
+	// Objects made here are never destroyed, only released with the arena,
+	// so T should not own anything outside it.
+	template<class T, class... Args>
+	T* New(Args&&... args)
+	{
+		return new (Allocate(sizeof(T), alignof(T))) T(forward<Args>(args)...);
+	};
+	const char* Copy(const char* s, size_t len);
+	void Adopt(Arena& other);
+	void Reset();
+	size_t GetUsed() { return used; };
+};
+
+#endif
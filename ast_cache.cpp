@@ -0,0 +1,219 @@
+#include "ast_cache.h"
+#include "flat_ast.h"
+#include "mapped_file.h"
+#include "symbol_table.h"
+#include "hash.h"
+#include <cstring>
+
+static const char AST_MAGIC[8] = { 'F', 'L', 'A', 'T', 'A', 'S', 'T', '1' };
+
+// The type counts tie the file to the enums it was written with. The
+// payload follows the header, widest columns first so every one of them
+// stays aligned in the mapping: literals, offsets, the three slots, the
+// list pool, line starts, name ends, kinds, operators, string literal
+// bytes and finally the identifier names back to back.
+struct ASTHeader
+{
+	CacheStamp stamp;
+	unsigned int ast_types;
+	unsigned int token_types;
+	unsigned int node_count;
+	unsigned int pool_size;
+	unsigned int literal_count;
+	unsigned int string_bytes;
+	unsigned int line_count;
+	unsigned int symbol_count;
+	unsigned int name_bytes;
+	unsigned int reserved;
+};
+
+static unsigned long long PayloadSize(const ASTHeader& h)
+{
+	return (unsigned long long)h.literal_count * sizeof(TokenLiteral)
+		+ (unsigned long long)h.node_count * (4 * sizeof(unsigned int) + 2)
+		+ ((unsigned long long)h.pool_size + h.line_count + h.symbol_count) * sizeof(unsigned int)
+		+ h.string_bytes + h.name_bytes;
+}
+
+ASTCache::ASTCache(const char* cache_path, const char* source, size_t source_size)
+	: path(cache_path), src(source), size(source_size)
+{
+	hash = HashBytes(src, size);
+}
+
+// Children come after their parent in preorder, which also rules out
+// cycles in a corrupt file.
+static bool CheckChild(NodeIndex parent, NodeIndex child, unsigned int count)
+{
+	return child > parent && child < count;
+}
+
+static bool CheckNodes(const FlatColumns& c, unsigned int symbol_count, unsigned int source_size)
+{
+	if (c.kinds[0] != AST_PROGRAM)
+		return false;
+
+	for (NodeIndex n = 0; n < c.size; ++n)
+	{
+		if (c.kinds[n] > AST_FLOAT || c.ops[n] > TOKEN_UNKNOWN || c.offsets[n] > source_size)
+			return false;
+
+		const SlotRole* roles = SLOT_ROLES[c.kinds[n]];
+		for (unsigned int s = 0; s < 3; ++s)
+		{
+			unsigned int v = c.slots[s][n];
+			if (roles[s] == SLOT_NODE)
+			{
+				if (v != NODE_NONE && !CheckChild(n, v, c.size))
+					return false;
+			}
+			else if (roles[s] == SLOT_LIST)
+			{
+				if (v >= c.pool_size || c.pool[v] > c.pool_size - v - 1)
+					return false;
+				for (unsigned int i = 1; i <= c.pool[v]; ++i)
+				{
+					if (!CheckChild(n, c.pool[v + i], c.size))
+						return false;
+				}
+			}
+		}
+
+		unsigned int a = c.slots[0][n], b = c.slots[1][n];
+		switch(c.kinds[n])
+		{
+		case AST_ID:
+			if (a >= symbol_count)
+				return false;
+			break;
+		case AST_STRING:
+			if (a > c.string_bytes || b > c.string_bytes - a)
+				return false;
+			break;
+		case AST_INT:
+		case AST_FLOAT:
+			if (a >= c.literal_count)
+				return false;
+			break;
+		default:
+			break;
+		}
+	}
+
+	for (unsigned int i = 0; i < c.line_count; ++i)
+	{
+		if (c.lines[i] > source_size || (i == 0 ? c.lines[i] != 0 : c.lines[i] < c.lines[i - 1]))
+			return false;
+	}
+	return true;
+}
+
+bool ASTCache::Load(FlatAST& ast, SymbolTable& symbols)
+{
+	MappedFile* file = new MappedFile(path.c_str());
+	if (file->IsFail() || file->GetSize() < sizeof(ASTHeader))
+	{
+		delete file;
+		return false;
+	}
+
+	ASTHeader h;
+	memcpy(&h, file->GetData(), sizeof(h));
+	const char* p = file->GetData() + sizeof(h);
+	if (h.ast_types != AST_FLOAT + 1 || h.token_types != TOKEN_UNKNOWN + 1
+		|| PayloadSize(h) != file->GetSize() - sizeof(h) || h.node_count == 0
+		|| !CheckStamp(h.stamp, AST_MAGIC, VERSION, hash, size, p, PayloadSize(h)))
+	{
+		delete file;
+		return false;
+	}
+
+	unsigned int n = h.node_count;
+	FlatColumns c;
+	c.literals = (const TokenLiteral*)p;
+	p += h.literal_count * sizeof(TokenLiteral);
+	const unsigned int* columns = (const unsigned int*)p;
+	c.offsets = columns;
+	for (unsigned int s = 0; s < 3; ++s)
+		c.slots[s] = columns + (s + 1) * n;
+	c.pool = columns + 4 * n;
+	c.lines = c.pool + h.pool_size;
+	const unsigned int* name_ends = c.lines + h.line_count;
+	p = (const char*)(name_ends + h.symbol_count);
+	c.kinds = (const unsigned char*)p;
+	c.ops = c.kinds + n;
+	c.strings = (const char*)(c.ops + n);
+	const char* names = c.strings + h.string_bytes;
+	c.size = n;
+	c.pool_size = h.pool_size;
+	c.literal_count = h.literal_count;
+	c.string_bytes = h.string_bytes;
+	c.line_count = h.line_count;
+
+	bool ok = CheckNodes(c, h.symbol_count, (unsigned int)size);
+	vector<unsigned int> remap(h.symbol_count);
+	unsigned int start = 0;
+	for (unsigned int k = 0; k < h.symbol_count && ok; ++k)
+	{
+		unsigned int end = name_ends[k];
+		ok = (end >= start && end <= h.name_bytes);
+		if (ok)
+			remap[k] = symbols.Intern(names + start, end - start);
+		start = end;
+	}
+	if (!ok)
+	{
+		delete file;
+		return false;
+	}
+
+	ast.Clear();
+	ast.cols = c;
+	ast.symbols.swap(remap);
+	ast.file = file;
+	return true;
+}
+
+bool ASTCache::Save(const FlatAST& ast, const SymbolTable& symbols)
+{
+	const FlatColumns& c = ast.cols;
+	unsigned int n = c.size;
+	if (n == 0)
+		return false;
+
+	vector<unsigned int> name_ends;
+	string names;
+	for (unsigned int k = 0; k < ast.symbols.size(); ++k)
+	{
+		names.append(symbols.GetName(ast.symbols[k]));
+		name_ends.push_back((unsigned int)names.size());
+	}
+
+	ASTHeader h;
+	memset(&h, 0, sizeof(h));
+	h.ast_types = AST_FLOAT + 1;
+	h.token_types = TOKEN_UNKNOWN + 1;
+	h.node_count = n;
+	h.pool_size = c.pool_size;
+	h.literal_count = c.literal_count;
+	h.string_bytes = c.string_bytes;
+	h.line_count = c.line_count;
+	h.symbol_count = (unsigned int)name_ends.size();
+	h.name_bytes = (unsigned int)names.size();
+
+	string payload;
+	payload.reserve(PayloadSize(h));
+	payload.append((const char*)c.literals, h.literal_count * sizeof(TokenLiteral));
+	payload.append((const char*)c.offsets, n * sizeof(unsigned int));
+	for (unsigned int s = 0; s < 3; ++s)
+		payload.append((const char*)c.slots[s], n * sizeof(unsigned int));
+	payload.append((const char*)c.pool, h.pool_size * sizeof(unsigned int));
+	payload.append((const char*)c.lines, h.line_count * sizeof(unsigned int));
+	payload.append((const char*)name_ends.data(), name_ends.size() * sizeof(unsigned int));
+	payload.append((const char*)c.kinds, n);
+	payload.append((const char*)c.ops, n);
+	payload.append(c.strings, h.string_bytes);
+	payload.append(names);
+	StampCache(h.stamp, AST_MAGIC, VERSION, hash, size, payload);
+	return SaveCacheFile(path, &h, sizeof(h), payload);
+}
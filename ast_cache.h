@@ -0,0 +1,32 @@
+#ifndef _AST_CACHE_H_
+#define _AST_CACHE_H_
+
+#include <string>
+using namespace std;
+
+class FlatAST;
+class SymbolTable;
+
+// A flat AST saved next to its source, keyed by a hash of the source text
+// like TokenCache. Load maps the file and points the tree's columns into
+// it, so nothing is copied or fixed up per node; only the identifier
+// names are interned. A file that does not check out makes Load fail so
+// that the caller lexes and parses.
+class ASTCache
+{
+private:
+	string path;
+	const char* src;
+	size_t size;
+	unsigned long long hash;
+
+public:
+	static const unsigned int VERSION = 1;
+
+	ASTCache(const char* cache_path, const char* source, size_t source_size);
+
+	bool Load(FlatAST& ast, SymbolTable& symbols);
+	bool Save(const FlatAST& ast, const SymbolTable& symbols);
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <string>
+using namespace std;
+
+// Source text for the benchmarks, from a fixed xorshift sequence so that
+// every run and every build measures the same input. A benchmark derives
+// its own line kinds from it.
+class Generator
+{
+protected:
+	unsigned long long state;
+	string& out;
+
+public:
+	Generator(string& o, unsigned long long seed) : state(seed), out(o) {};
+
+	unsigned int Next()
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return (unsigned int)(state >> 16);
+	};
+	unsigned int Range(unsigned int n) { return Next() % n; };
+
+	void Name()
+	{
+		static const char* stems[] = {
+			"self", "data", "buf", "client", "server", "socket", "index",
+			"value", "result", "count", "item", "node", "table", "row"
+		};
+		out += stems[Range(14)];
+		if (Range(3) == 0)
+		{
+			out += '_';
+			out += to_string(Range(5000));
+		}
+	};
+};
+
+template<class G>
+struct Corpus
+{
+	const char* name;
+	void (G::*line)();
+};
+
+// Fills source with lines of the index'th corpus until it holds mb
+// megabytes.
+template<class G>
+void BuildCorpus(string& source, unsigned int mb, size_t index, const Corpus<G>& corpus)
+{
+	size_t target = (size_t)mb << 20;
+	source.reserve(target + 4096);
+	G gen(source, 0x2545F4914F6CDD1Dull + index);
+	while(source.size() < target)
+		(gen.*corpus.line)();
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include "lexer.h"
+#include <chrono>
+#include <vector>
+
+static TokenType ChainLookup(const string& buf)
+{
+	TokenType type = TOKEN_ID;
+	if (buf == "for")
+	{
+		type = TOKEN_FOR;
+	}
+	else if (buf == "while")
+	{
+		type = TOKEN_WHILE;
+	}
+	else if (buf == "if")
+	{
+		type = TOKEN_IF;
+	}
+	else if (buf == "else")
+	{
+		type = TOKEN_ELSE;
+	}
+	else if (buf == "elif")
+	{
+		type = TOKEN_ELIF;
+	}
+	else if (buf == "end")
+	{
+		type = TOKEN_END;
+	}
+	else if (buf == "def")
+	{
+		type = TOKEN_DEF;
+	}
+	else if (buf == "break")
+	{
+		type = TOKEN_BREAK;
+	}
+	else if (buf == "return")
+	{
+		type = TOKEN_RETURN;
+	}
+	else if (buf == "continue")
+	{
+		type = TOKEN_CONTINUE;
+	}
+	else if (buf == "in")
+	{
+		type = TOKEN_IN;
+	}
+	return type;
+}
+
+int main(int argc, char** argv)
+{
+	const char* names[] = {
+		"self", "data", "buf", "client", "server", "sockets", "rs", "i",
+		"handle", "select", "socket", "append", "len", "print", "addr",
+		"index", "value", "result", "counter", "iterator", "element",
+		"for", "while", "if", "else", "elif", "end", "def", "break",
+		"return", "continue", "in"
+	};
+	const int name_count = sizeof(names) / sizeof(names[0]);
+	const int ident_count = name_count - KEYWORD_COUNT;
+	const int words = 1 << 16;
+	const int rounds = (argc > 1 ? atoi(argv[1]) : 200);
+
+	vector<string> corpus;
+	unsigned int seed = 12345;
+	for (int i = 0; i < words; ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+		// roughly four identifiers for every keyword
+		unsigned int r = (seed >> 16) % 100;
+		int pick = (r < 80 ? (seed >> 8) % ident_count : ident_count + (seed >> 8) % KEYWORD_COUNT);
+		corpus.push_back(names[pick]);
+	}
+
+	for (int i = 0; i < words; ++i)
+	{
+		const string& s = corpus[i];
+		if (ChainLookup(s) != LookupKeyword(s.data(), s.size()))
+		{
+			cerr << "[Error] Keyword lookup mismatch on \"" << s << "\"" << endl;
+			return -1;
+		}
+	}
+
+	unsigned long sum = 0;
+	chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+	for (int r = 0; r < rounds; ++r)
+		for (int i = 0; i < words; ++i)
+			sum += ChainLookup(corpus[i]);
+	chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+	for (int r = 0; r < rounds; ++r)
+		for (int i = 0; i < words; ++i)
+			sum += LookupKeyword(corpus[i].data(), corpus[i].size());
+	chrono::steady_clock::time_point t2 = chrono::steady_clock::now();
+
+	double n = (double)rounds * words;
+	double chain = chrono::duration<double, nano>(t1 - t0).count() / n;
+	double hash = chrono::duration<double, nano>(t2 - t1).count() / n;
+	cout << "chain: " << chain << " ns/lookup" << endl;
+	cout << "hash:  " << hash << " ns/lookup" << endl;
+	cout << "speedup: " << chain / hash << "x (checksum " << sum << ")" << endl;
+
+	return 0;
+}
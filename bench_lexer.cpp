@@ -0,0 +1,182 @@
+#include "lexer.h"
+#include "alloc_counter.h"
+#include "bench.h"
+#include "scan.h"
+#include "thread_pool.h"
+#include <chrono>
+#include <cstdlib>
+
+class LexerCorpus : public Generator
+{
+public:
+	LexerCorpus(string& o, unsigned long long seed) : Generator(o, seed) {};
+
+	void Text(unsigned int n)
+	{
+		for (unsigned int i = 0; i < n; ++i)
+			out += (Range(7) == 0 ? ' ' : (char)('a' + Range(26)));
+	};
+
+	void IdentLine()
+	{
+		Name();
+		out += " = ";
+		Name();
+		out += '.';
+		Name();
+		out += '(';
+		Name();
+		out += ", ";
+		Name();
+		out += ")\n";
+	};
+	void OperatorLine()
+	{
+		static const char* ops[] = {
+			"+", "-", "*", "/", "%", "&", "|", "^", "<=", ">=", "==", "!=",
+			"&&", "||", "<", ">", "+=", "-=", "++", "--"
+		};
+		out += (char)('a' + Range(26));
+		for (unsigned int i = 0, n = 8 + Range(16); i < n; ++i)
+		{
+			out += ops[Range(20)];
+			out += (char)('a' + Range(26));
+		}
+		out += '\n';
+	};
+	void StringLine()
+	{
+		Name();
+		out += " = \"";
+		Text(100 + Range(400));
+		out += "\"\n";
+	};
+	void CommentLine()
+	{
+		if (Range(8) == 0)
+		{
+			IdentLine();
+			return;
+		}
+		out += "# ";
+		Text(40 + Range(160));
+		out += '\n';
+	};
+	void NestedLine()
+	{
+		static const char open[] = "([{";
+		static const char close[] = ")]}";
+		unsigned int depth = 16 + Range(48);
+		string closing;
+		Name();
+		out += " = ";
+		for (unsigned int i = 0; i < depth; ++i)
+		{
+			unsigned int k = Range(3);
+			out += open[k];
+			if (k == 2)
+			{
+				Name();
+				out += ": ";
+			}
+			closing += close[k];
+		}
+		out += to_string(Range(1000));
+		out.append(closing.rbegin(), closing.rend());
+		out += '\n';
+	};
+};
+
+static const Corpus<LexerCorpus> CORPORA[] = {
+	{ "ident", &LexerCorpus::IdentLine },
+	{ "operator", &LexerCorpus::OperatorLine },
+	{ "string", &LexerCorpus::StringLine },
+	{ "comment", &LexerCorpus::CommentLine },
+	{ "nested", &LexerCorpus::NestedLine },
+};
+
+int main(int argc, char** argv)
+{
+	vector<unsigned int> sizes;
+	unsigned int repeat = 3;
+	unsigned int threads = 1;
+	for (int i = 1; i < argc; ++i)
+	{
+		string arg = argv[i];
+		if (arg == "--size" && i + 1 < argc)
+			sizes.push_back(atoi(argv[++i]));
+		else if (arg == "--repeat" && i + 1 < argc)
+			repeat = atoi(argv[++i]);
+		else if (arg == "--threads" && i + 1 < argc)
+			threads = atoi(argv[++i]);
+		else
+		{
+			cerr << "usage: bench_lexer [--size MB]... [--repeat N] [--threads N]" << endl;
+			return -1;
+		}
+	}
+	if (sizes.empty())
+	{
+		sizes.push_back(1);
+		sizes.push_back(10);
+		sizes.push_back(100);
+	}
+	if (repeat == 0)
+		repeat = 1;
+
+	ThreadPool* pool = (threads > 1 ? new ThreadPool(threads) : NULL);
+	const char* levels[] = { "scalar", "sse2", "avx2" };
+
+	for (size_t s = 0; s < sizes.size(); ++s)
+	{
+		for (size_t c = 0; c < sizeof(CORPORA) / sizeof(CORPORA[0]); ++c)
+		{
+			string source;
+			BuildCorpus(source, sizes[s], c, CORPORA[c]);
+
+			double best = 0;
+			unsigned long long tokens = 0;
+			unsigned long long allocs = 0;
+			unsigned long long bytes = 0;
+			bool fail = false;
+			for (unsigned int r = 0; r < repeat; ++r)
+			{
+				unsigned long long count0 = GetAllocCount();
+				unsigned long long bytes0 = GetAllocBytes();
+				chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+				Lexer* lexer = new Lexer(source.data(), source.size(), pool);
+				chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+				double sec = chrono::duration<double>(t1 - t0).count();
+				if (r == 0)
+				{
+					allocs = GetAllocCount() - count0;
+					bytes = GetAllocBytes() - bytes0;
+					tokens = lexer->GetTokens().GetSize();
+					fail = lexer->IsFail();
+				}
+				if (r == 0 || sec < best)
+					best = sec;
+				delete lexer;
+			}
+
+			double mb = (double)source.size() / (1 << 20);
+			cout << "{\"corpus\":\"" << CORPORA[c].name << "\""
+				<< ",\"size_mb\":" << sizes[s]
+				<< ",\"bytes\":" << source.size()
+				<< ",\"tokens\":" << tokens
+				<< ",\"threads\":" << (pool ? pool->GetSize() : 1)
+				<< ",\"scan\":\"" << levels[GetScanLevel()] << "\""
+				<< ",\"seconds\":" << best
+				<< ",\"mb_per_s\":" << mb / best
+				<< ",\"tokens_per_s\":" << tokens / best
+				<< ",\"allocs\":" << allocs
+				<< ",\"alloc_bytes_per_token\":" << (tokens ? (double)bytes / tokens : 0)
+				<< ",\"fail\":" << (fail ? "true" : "false")
+				<< "}" << endl;
+		}
+	}
+
+	if (pool)
+		delete pool;
+	return 0;
+}
@@ -0,0 +1,324 @@
+#include "lexer.h"
+#include "parser.h"
+#include "bench.h"
+#include <chrono>
+#include <cstdlib>
+#include <sstream>
+
+class ParserCorpus : public Generator
+{
+private:
+	unsigned int indent;
+
+public:
+	ParserCorpus(string& o, unsigned long long seed) : Generator(o, seed), indent(0) {};
+
+	void Indent() { out.append(indent, '\t'); };
+
+	void Operand(unsigned int depth)
+	{
+		switch(depth ? Range(10) : Range(4))
+		{
+		case 0:
+		case 1:
+			Name();
+			break;
+		case 2:
+			out += to_string(Range(100000));
+			break;
+		case 3:
+			out += "\"";
+			Name();
+			out += "\"";
+			break;
+		case 4:
+			Name();
+			out += '.';
+			Name();
+			break;
+		case 5:
+			Name();
+			out += '(';
+			Expr(depth - 1);
+			out += ", ";
+			Expr(depth - 1);
+			out += ')';
+			break;
+		case 6:
+			Name();
+			out += '[';
+			Expr(depth - 1);
+			out += ']';
+			break;
+		case 7:
+			out += '(';
+			Expr(depth - 1);
+			out += ')';
+			break;
+		case 8:
+			out += '[';
+			Expr(depth - 1);
+			out += ", ";
+			Expr(depth - 1);
+			out += ']';
+			break;
+		default:
+			out += (Range(2) ? "-" : "!");
+			Name();
+			break;
+		}
+	};
+	void Expr(unsigned int depth)
+	{
+		static const char* ops[] = {
+			" + ", " - ", " * ", " / ", " % ", " & ", " | ", " ^ ", " <= ", " >= ",
+			" == ", " != ", " && ", " || ", " < ", " > "
+		};
+		Operand(depth);
+		for (unsigned int i = 0, n = Range(4); i < n; ++i)
+		{
+			out += ops[Range(16)];
+			Operand(depth);
+		}
+	};
+	void Assign()
+	{
+		Indent();
+		Name();
+		out += (Range(4) ? " = " : " += ");
+		Expr(2);
+		out += '\n';
+	};
+
+	// Straight-line code: assignments and calls at the top level.
+	void StatementLine()
+	{
+		if (Range(4) == 0)
+		{
+			Name();
+			out += '.';
+			Name();
+			out += '(';
+			Expr(1);
+			out += ")\n";
+			return;
+		}
+		Assign();
+	};
+	// A function with loops and branches nested a few levels deep.
+	void BlockLine()
+	{
+		out += "def ";
+		Name();
+		out += "(a, b)\n";
+		++indent;
+		Block(3);
+		Indent();
+		out += "return ";
+		Expr(1);
+		out += "\n";
+		--indent;
+		out += "end\n";
+	};
+	void Block(unsigned int depth)
+	{
+		for (unsigned int i = 0, n = 2 + Range(4); i < n; ++i)
+		{
+			if (depth == 0 || Range(3))
+			{
+				Assign();
+				continue;
+			}
+			Indent();
+			switch(Range(3))
+			{
+			case 0:
+				out += "if ";
+				Expr(1);
+				out += "\n";
+				++indent;
+				Block(depth - 1);
+				--indent;
+				Indent();
+				out += "else\n";
+				++indent;
+				Block(depth - 1);
+				--indent;
+				break;
+			case 1:
+				out += "for ";
+				Name();
+				out += " in ";
+				Name();
+				out += "\n";
+				++indent;
+				Block(depth - 1);
+				--indent;
+				break;
+			default:
+				out += "while ";
+				Expr(1);
+				out += "\n";
+				++indent;
+				Block(depth - 1);
+				Indent();
+				out += "break\n";
+				--indent;
+				break;
+			}
+			Indent();
+			out += "end\n";
+		}
+	};
+	// Container literals spread over several lines.
+	void LiteralLine()
+	{
+		Name();
+		out += " = {\n";
+		for (unsigned int i = 0, n = 2 + Range(6); i < n; ++i)
+		{
+			out += "\t\"";
+			Name();
+			out += "\": [";
+			for (unsigned int j = 0, m = 1 + Range(6); j < m; ++j)
+			{
+				out += (j ? ", " : "");
+				Operand(1);
+			}
+			out += "],\n";
+		}
+		out += "}\n";
+	};
+	void NestedLine()
+	{
+		static const char open[] = "([";
+		static const char close[] = ")]";
+		unsigned int depth = 16 + Range(48);
+		string closing;
+		Name();
+		out += " = ";
+		for (unsigned int i = 0; i < depth; ++i)
+		{
+			unsigned int k = Range(2);
+			out += open[k];
+			closing += close[k];
+		}
+		out += to_string(Range(1000));
+		out.append(closing.rbegin(), closing.rend());
+		out += '\n';
+	};
+};
+
+static const Corpus<ParserCorpus> CORPORA[] = {
+	{ "statement", &ParserCorpus::StatementLine },
+	{ "block", &ParserCorpus::BlockLine },
+	{ "literal", &ParserCorpus::LiteralLine },
+	{ "nested", &ParserCorpus::NestedLine },
+};
+
+struct Engine
+{
+	const char* name;
+	bool explicit_stack;
+	bool table_driven;
+};
+
+static const Engine ENGINES[] = {
+	{ "recursive", false, false },
+	{ "explicit", true, false },
+	{ "table", false, true },
+};
+
+int main(int argc, char** argv)
+{
+	vector<unsigned int> sizes;
+	unsigned int repeat = 3;
+	for (int i = 1; i < argc; ++i)
+	{
+		string arg = argv[i];
+		if (arg == "--size" && i + 1 < argc)
+			sizes.push_back(atoi(argv[++i]));
+		else if (arg == "--repeat" && i + 1 < argc)
+			repeat = atoi(argv[++i]);
+		else
+		{
+			cerr << "usage: bench_parser [--size MB]... [--repeat N]" << endl;
+			return -1;
+		}
+	}
+	if (sizes.empty())
+	{
+		sizes.push_back(1);
+		sizes.push_back(10);
+		sizes.push_back(50);
+	}
+	if (repeat == 0)
+		repeat = 1;
+
+	for (size_t s = 0; s < sizes.size(); ++s)
+	{
+		for (size_t c = 0; c < sizeof(CORPORA) / sizeof(CORPORA[0]); ++c)
+		{
+			string source;
+			BuildCorpus(source, sizes[s], c, CORPORA[c]);
+
+			Lexer lexer(source.data(), source.size());
+			if (lexer.IsFail())
+			{
+				cerr << "corpus " << CORPORA[c].name << " does not lex" << endl;
+				return -1;
+			}
+			unsigned long long tokens = lexer.GetTokens().GetSize();
+			string reference;
+
+			for (size_t e = 0; e < sizeof(ENGINES) / sizeof(ENGINES[0]); ++e)
+			{
+				double best = 0;
+				size_t memory = 0;
+				bool fail = false;
+				bool same = true;
+				for (unsigned int r = 0; r < repeat; ++r)
+				{
+					vector<Diagnostic> diags;
+					Parser* parser = new Parser(lexer, &diags);
+					parser->SetExplicitStack(ENGINES[e].explicit_stack);
+					parser->SetTableDriven(ENGINES[e].table_driven);
+					chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+					parser->Parse();
+					chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+					double sec = chrono::duration<double>(t1 - t0).count();
+					if (r == 0)
+					{
+						memory = parser->GetMemory();
+						fail = !diags.empty();
+						ostringstream tree;
+						parser->Dump(tree);
+						if (e == 0)
+							reference = tree.str();
+						else
+							same = (tree.str() == reference);
+					}
+					if (r == 0 || sec < best)
+						best = sec;
+					delete parser;
+				}
+
+				double mb = (double)source.size() / (1 << 20);
+				cout << "{\"corpus\":\"" << CORPORA[c].name << "\""
+					<< ",\"engine\":\"" << ENGINES[e].name << "\""
+					<< ",\"size_mb\":" << sizes[s]
+					<< ",\"bytes\":" << source.size()
+					<< ",\"tokens\":" << tokens
+					<< ",\"seconds\":" << best
+					<< ",\"mb_per_s\":" << mb / best
+					<< ",\"tokens_per_s\":" << tokens / best
+					<< ",\"arena_bytes\":" << memory
+					<< ",\"same_tree\":" << (same ? "true" : "false")
+					<< ",\"fail\":" << (fail ? "true" : "false")
+					<< "}" << endl;
+			}
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,369 @@
+#include "flat_ast.h"
+#include "symbol_table.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <cstring>
+
+FlatAST::FlatAST() : file(NULL)
+{
+	Publish();
+}
+
+FlatAST::~FlatAST()
+{
+	delete file;
+}
+
+void FlatAST::Clear()
+{
+	kinds.clear();
+	ops.clear();
+	offsets.clear();
+	for (unsigned int s = 0; s < 3; ++s)
+		slots[s].clear();
+	pool.clear();
+	literals.clear();
+	strings.clear();
+	lines.clear();
+	symbols.clear();
+	delete file;
+	file = NULL;
+	Publish();
+}
+
+// Points the columns at the vectors.
+void FlatAST::Publish()
+{
+	cols.kinds = kinds.data();
+	cols.ops = ops.data();
+	cols.offsets = offsets.data();
+	for (unsigned int s = 0; s < 3; ++s)
+		cols.slots[s] = slots[s].data();
+	cols.pool = pool.data();
+	cols.literals = literals.data();
+	cols.strings = strings.data();
+	cols.lines = lines.data();
+	cols.size = (unsigned int)kinds.size();
+	cols.pool_size = (unsigned int)pool.size();
+	cols.literal_count = (unsigned int)literals.size();
+	cols.string_bytes = (unsigned int)strings.size();
+	cols.line_count = (unsigned int)lines.size();
+}
+
+size_t FlatAST::GetMemory() const
+{
+	size_t size = kinds.capacity() + ops.capacity()
+		+ offsets.capacity() * sizeof(unsigned int)
+		+ pool.capacity() * sizeof(unsigned int)
+		+ literals.capacity() * sizeof(TokenLiteral)
+		+ strings.capacity()
+		+ lines.capacity() * sizeof(unsigned int)
+		+ symbols.capacity() * sizeof(unsigned int);
+	for (unsigned int s = 0; s < 3; ++s)
+		size += slots[s].capacity() * sizeof(unsigned int);
+	return size;
+}
+
+int FlatAST::GetLine(NodeIndex n) const
+{
+	if (cols.line_count == 0)
+		return 0;
+	const unsigned int* line = upper_bound(cols.lines, cols.lines + cols.line_count, cols.offsets[n]);
+	return (int)(line - cols.lines);
+}
+
+NodeIndex FlatAST::Add(ASTType kind, TokenType op, unsigned int offset)
+{
+	NodeIndex n = (NodeIndex)kinds.size();
+	kinds.push_back((unsigned char)kind);
+	ops.push_back((unsigned char)op);
+	offsets.push_back(offset);
+	for (unsigned int s = 0; s < 3; ++s)
+		slots[s].push_back(NODE_NONE);
+	return n;
+}
+
+// The list's slots are reserved before its members are lowered, since the
+// members may append lists of their own.
+unsigned int FlatAST::AddList(const ParamList& list)
+{
+	unsigned int start = (unsigned int)pool.size();
+	pool.resize(start + 1 + list.GetSize());
+	pool[start] = list.GetSize();
+
+	unsigned int i = start + 1;
+	for (const NodeLink* l = list.GetHead(); l; l = l->next)
+	{
+		NodeIndex child = Lower(l->node);
+		pool[i++] = child;
+	}
+	return start;
+}
+
+unsigned int FlatAST::AddMapping(const MappingNode* node)
+{
+	unsigned int size = node->GetKeys().GetSize() * 2;
+	unsigned int start = (unsigned int)pool.size();
+	pool.resize(start + 1 + size);
+	pool[start] = size;
+
+	unsigned int i = start + 1;
+	const NodeLink* v = node->GetValues().GetHead();
+	for (const NodeLink* k = node->GetKeys().GetHead(); k; k = k->next, v = v->next)
+	{
+		NodeIndex key = Lower(k->node);
+		pool[i++] = key;
+		NodeIndex value = Lower(v->node);
+		pool[i++] = value;
+	}
+	return start;
+}
+
+NodeIndex FlatAST::Lower(const ASTNode* node)
+{
+	if (!node)
+		return NODE_NONE;
+
+	ASTType type = node->GetType();
+	NodeIndex n = Add(type, (TokenType)0, node->GetOffset());
+	unsigned int a = NODE_NONE, b = NODE_NONE, c = NODE_NONE;
+
+	switch(type)
+	{
+	case AST_PROGRAM:
+		a = AddList(((const ProgramNode*)node)->GetStatements());
+		break;
+	case AST_ID:
+	{
+		unsigned int id = ((const IdNode*)node)->GetSymbol();
+		if (id >= locals.size())
+			locals.resize(id + 1, ~0u);
+		if (locals[id] == ~0u)
+		{
+			locals[id] = (unsigned int)symbols.size();
+			symbols.push_back(id);
+		}
+		a = locals[id];
+		break;
+	}
+	case AST_STRING:
+	{
+		string_view text = ((const StringNode*)node)->GetText();
+		a = (unsigned int)strings.size();
+		b = (unsigned int)text.size();
+		strings.append(text.data(), text.size());
+		break;
+	}
+	case AST_INT:
+	{
+		TokenLiteral v;
+		v.i = ((const IntNode*)node)->GetValue();
+		a = (unsigned int)literals.size();
+		literals.push_back(v);
+		break;
+	}
+	case AST_FLOAT:
+	{
+		TokenLiteral v;
+		v.f = ((const FloatNode*)node)->GetValue();
+		a = (unsigned int)literals.size();
+		literals.push_back(v);
+		break;
+	}
+	case AST_ELEMENTS:
+		a = AddList(((const ElementsNode*)node)->GetElements());
+		break;
+	case AST_MAPPING:
+		a = AddMapping((const MappingNode*)node);
+		break;
+	case AST_IF:
+	{
+		const IfNode* in = (const IfNode*)node;
+		a = Lower(in->GetCondition());
+		b = AddList(in->GetStatements());
+		c = AddList(in->GetElseStatements());
+		break;
+	}
+	case AST_FUNCTION:
+	{
+		const FunctionNode* fn = (const FunctionNode*)node;
+		a = Lower(fn->GetFunction());
+		b = Lower(fn->GetParam());
+		c = AddList(fn->GetStatements());
+		break;
+	}
+	case AST_FOR:
+	{
+		const ForNode* fn = (const ForNode*)node;
+		a = Lower(fn->GetIterator());
+		b = Lower(fn->GetIterList());
+		c = AddList(fn->GetStatements());
+		break;
+	}
+	case AST_WHILE:
+	{
+		const WhileNode* wn = (const WhileNode*)node;
+		a = Lower(wn->GetCondition());
+		b = AddList(wn->GetStatements());
+		break;
+	}
+	case AST_RETURN:
+		a = Lower(((const ReturnNode*)node)->GetReturn());
+		break;
+	case AST_BREAK:
+	case AST_CONTINUE:
+		break;
+	case AST_ASSIGN:
+	case AST_BOOL:
+	case AST_LOGIC:
+	case AST_CMP:
+	case AST_ADD:
+	case AST_MULTI:
+	{
+		const BinaryNode* bn = (const BinaryNode*)node;
+		ops[n] = (unsigned char)bn->GetOperator();
+		a = Lower(bn->GetLeft());
+		b = Lower(bn->GetRight());
+		break;
+	}
+	case AST_UNARY:
+	case AST_POST:
+	{
+		const UnaryNode* un = (const UnaryNode*)node;
+		ops[n] = (unsigned char)un->GetOperator();
+		a = Lower(un->GetParam());
+		break;
+	}
+	case AST_INVOKE:
+	{
+		const InvokeNode* in = (const InvokeNode*)node;
+		a = Lower(in->GetInstance());
+		b = Lower(in->GetAttr());
+		break;
+	}
+	case AST_CALL:
+	{
+		const CallNode* cn = (const CallNode*)node;
+		a = Lower(cn->GetFunction());
+		b = Lower(cn->GetParams());
+		break;
+	}
+	case AST_INDEX:
+	{
+		const IndexNode* in = (const IndexNode*)node;
+		a = Lower(in->GetSource());
+		b = Lower(in->GetIndex());
+		break;
+	}
+	case AST_LIST:
+		a = Lower(((const ListNode*)node)->GetElements());
+		break;
+	case AST_DICT:
+		a = Lower(((const DictNode*)node)->GetMapping());
+		break;
+	}
+
+	slots[0][n] = a;
+	slots[1][n] = b;
+	slots[2][n] = c;
+	return n;
+}
+
+void FlatAST::Build(const ProgramNode* root, string_view source)
+{
+	Clear();
+	Lower(root);
+	locals.clear();
+
+	if (!source.empty())
+	{
+		lines.push_back(0);
+		const char* text = source.data();
+		const char* end = text + source.size();
+		for (const char* p = text; (p = (const char*)memchr(p, '\n', end - p)) != NULL; ++p)
+			lines.push_back((unsigned int)(p + 1 - text));
+	}
+	Publish();
+}
+
+static void DumpNode(ostream& os, const FlatAST& ast, const SymbolTable& symbols,
+	NodeIndex n, int depth);
+
+static void DumpList(ostream& os, const FlatAST& ast, const SymbolTable& symbols,
+	NodeIndex n, unsigned int slot, int depth)
+{
+	const NodeIndex* list = ast.GetList(n, slot);
+	for (unsigned int i = 0, size = ast.GetListSize(n, slot); i < size; ++i)
+		DumpNode(os, ast, symbols, list[i], depth);
+}
+
+static void DumpNode(ostream& os, const FlatAST& ast, const SymbolTable& symbols,
+	NodeIndex n, int depth)
+{
+	if (n == NODE_NONE)
+		return;
+	ASTType type = ast.GetKind(n);
+	os << string(depth * 2, ' ') << ASTName(type);
+
+	switch(type)
+	{
+	case AST_ID:
+		os << ' ' << symbols.GetName(ast.GetSymbol(n)) << endl;
+		break;
+	case AST_STRING:
+		os << " \"" << ast.GetString(n) << '\"' << endl;
+		break;
+	case AST_INT:
+		os << ' ' << ast.GetInt(n) << endl;
+		break;
+	case AST_FLOAT:
+		os << ' ' << ast.GetFloat(n) << endl;
+		break;
+	case AST_MAPPING:
+	{
+		os << endl;
+		const NodeIndex* list = ast.GetList(n, 0);
+		for (unsigned int i = 0, size = ast.GetListSize(n, 0); i < size; i += 2)
+		{
+			DumpNode(os, ast, symbols, list[i], depth + 1);
+			DumpNode(os, ast, symbols, list[i + 1], depth + 2);
+		}
+		break;
+	}
+	case AST_IF:
+		os << endl;
+		DumpNode(os, ast, symbols, ast.GetChild(n, 0), depth + 1);
+		DumpList(os, ast, symbols, n, 1, depth + 1);
+		if (ast.GetListSize(n, 2) > 0)
+		{
+			os << string(depth * 2, ' ') << "else" << endl;
+			DumpList(os, ast, symbols, n, 2, depth + 1);
+		}
+		break;
+	case AST_ASSIGN:
+	case AST_BOOL:
+	case AST_LOGIC:
+	case AST_CMP:
+	case AST_ADD:
+	case AST_MULTI:
+	case AST_UNARY:
+	case AST_POST:
+		os << ' ' << OperatorText(ast.GetOperator(n)) << endl;
+		ast.ForEachChild(n, [&](NodeIndex c) {
+			DumpNode(os, ast, symbols, c, depth + 1);
+		});
+		break;
+	default:
+		os << endl;
+		ast.ForEachChild(n, [&](NodeIndex c) {
+			DumpNode(os, ast, symbols, c, depth + 1);
+		});
+		break;
+	}
+}
+
+void FlatAST::Dump(ostream& os, const SymbolTable& symbols) const
+{
+	if (GetSize() > 0)
+		DumpNode(os, *this, symbols, GetRoot(), 0);
+}
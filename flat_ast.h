@@ -0,0 +1,164 @@
+#ifndef _FLAT_AST_H_
+#define _FLAT_AST_H_
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <iostream>
+#include "lexer.h"
+#include "parser.h"
+using namespace std;
+
+class SymbolTable;
+class MappedFile;
+
+typedef unsigned int NodeIndex;
+
+const NodeIndex NODE_NONE = ~0u;
+
+enum SlotRole : unsigned char {
+	SLOT_EMPTY = 0, SLOT_NODE, SLOT_LIST, SLOT_VALUE
+};
+
+// What each of a node's three slots holds, by ASTType. A list slot points
+// at a count in the pool followed by that many node indices; a mapping
+// lists its keys and values interleaved.
+constexpr SlotRole SLOT_ROLES[][3] = {
+	{ SLOT_LIST, SLOT_EMPTY, SLOT_EMPTY },	// AST_PROGRAM
+	{ SLOT_NODE, SLOT_NODE, SLOT_EMPTY },	// AST_ASSIGN
+	{ SLOT_NODE, SLOT_LIST, SLOT_LIST },	// AST_IF
+	{ SLOT_NODE, SLOT_NODE, SLOT_LIST },	// AST_FUNCTION
+	{ SLOT_NODE, SLOT_NODE, SLOT_LIST },	// AST_FOR
+	{ SLOT_NODE, SLOT_LIST, SLOT_EMPTY },	// AST_WHILE
+	{ SLOT_NODE, SLOT_EMPTY, SLOT_EMPTY },	// AST_RETURN
+	{ SLOT_EMPTY, SLOT_EMPTY, SLOT_EMPTY },	// AST_BREAK
+	{ SLOT_EMPTY, SLOT_EMPTY, SLOT_EMPTY },	// AST_CONTINUE
+	{ SLOT_NODE, SLOT_NODE, SLOT_EMPTY },	// AST_BOOL
+	{ SLOT_NODE, SLOT_NODE, SLOT_EMPTY },	// AST_LOGIC
+	{ SLOT_NODE, SLOT_NODE, SLOT_EMPTY },	// AST_CMP
+	{ SLOT_NODE, SLOT_NODE, SLOT_EMPTY },	// AST_ADD
+	{ SLOT_NODE, SLOT_NODE, SLOT_EMPTY },	// AST_MULTI
+	{ SLOT_NODE, SLOT_EMPTY, SLOT_EMPTY },	// AST_UNARY
+	{ SLOT_NODE, SLOT_EMPTY, SLOT_EMPTY },	// AST_POST
+	{ SLOT_NODE, SLOT_NODE, SLOT_EMPTY },	// AST_INVOKE
+	{ SLOT_NODE, SLOT_NODE, SLOT_EMPTY },	// AST_CALL
+	{ SLOT_NODE, SLOT_NODE, SLOT_EMPTY },	// AST_INDEX
+	{ SLOT_NODE, SLOT_EMPTY, SLOT_EMPTY },	// AST_LIST
+	{ SLOT_NODE, SLOT_EMPTY, SLOT_EMPTY },	// AST_DICT
+	{ SLOT_LIST, SLOT_EMPTY, SLOT_EMPTY },	// AST_ELEMENTS
+	{ SLOT_LIST, SLOT_EMPTY, SLOT_EMPTY },	// AST_MAPPING
+	{ SLOT_VALUE, SLOT_EMPTY, SLOT_EMPTY },	// AST_ID
+	{ SLOT_VALUE, SLOT_VALUE, SLOT_EMPTY },	// AST_STRING
+	{ SLOT_VALUE, SLOT_EMPTY, SLOT_EMPTY },	// AST_INT
+	{ SLOT_VALUE, SLOT_EMPTY, SLOT_EMPTY },	// AST_FLOAT
+};
+
+// Where the accessors read the columns from: the vectors of a built tree,
+// or straight out of a mapped file.
+struct FlatColumns
+{
+	const unsigned char* kinds;
+	const unsigned char* ops;
+	const unsigned int* offsets;
+	const unsigned int* slots[3];
+	const unsigned int* pool;
+	const TokenLiteral* literals;
+	const char* strings;
+	const unsigned int* lines;
+	unsigned int size;
+	unsigned int pool_size;
+	unsigned int literal_count;
+	unsigned int string_bytes;
+	unsigned int line_count;
+};
+
+// The AST as parallel arrays. Nodes are laid out in preorder, so walking
+// the whole tree is a linear scan from the root at index 0. Identifiers
+// hold ids local to the tree, numbered in order of first use, which
+// symbols maps to the SymbolTable.
+class FlatAST
+{
+	friend class ASTCache;
+
+private:
+	vector<unsigned char> kinds;
+	vector<unsigned char> ops;
+	vector<unsigned int> offsets;
+	vector<unsigned int> slots[3];
+	vector<unsigned int> pool;
+	vector<TokenLiteral> literals;
+	string strings;
+	vector<unsigned int> lines;
+	vector<unsigned int> symbols;
+	vector<unsigned int> locals;
+	FlatColumns cols;
+	MappedFile* file;
+
+	NodeIndex Add(ASTType kind, TokenType op, unsigned int offset);
+	unsigned int AddList(const ParamList& list);
+	unsigned int AddMapping(const MappingNode* node);
+	NodeIndex Lower(const ASTNode* node);
+	void Publish();
+
+public:
+	FlatAST();
+	~FlatAST();
+	FlatAST(const FlatAST&) = delete;
+	FlatAST& operator=(const FlatAST&) = delete;
+
+	// With the source text the tree also keeps where its lines start.
+	void Build(const ProgramNode* root, string_view source = string_view());
+	void Clear();
+
+	NodeIndex GetRoot() const { return 0; };
+	NodeIndex GetSize() const { return cols.size; };
+	size_t GetMemory() const;
+	bool IsMapped() const { return file != NULL; };
+
+	ASTType GetKind(NodeIndex n) const { return (ASTType)cols.kinds[n]; };
+	TokenType GetOperator(NodeIndex n) const { return (TokenType)cols.ops[n]; };
+	unsigned int GetOffset(NodeIndex n) const { return cols.offsets[n]; };
+	// 1-based line of the node, or 0 when the tree has no line info.
+	int GetLine(NodeIndex n) const;
+	NodeIndex GetChild(NodeIndex n, unsigned int slot) const { return cols.slots[slot][n]; };
+	unsigned int GetListSize(NodeIndex n, unsigned int slot) const
+	{
+		return cols.pool[cols.slots[slot][n]];
+	};
+	const NodeIndex* GetList(NodeIndex n, unsigned int slot) const
+	{
+		return &cols.pool[cols.slots[slot][n] + 1];
+	};
+
+	unsigned int GetSymbol(NodeIndex n) const { return symbols[cols.slots[0][n]]; };
+	long long GetInt(NodeIndex n) const { return cols.literals[cols.slots[0][n]].i; };
+	double GetFloat(NodeIndex n) const { return cols.literals[cols.slots[0][n]].f; };
+	string_view GetString(NodeIndex n) const
+	{
+		return string_view(cols.strings + cols.slots[0][n], cols.slots[1][n]);
+	};
+
+	// Calls f on every child of n in source order, lists included.
+	template<class F>
+	void ForEachChild(NodeIndex n, F f) const
+	{
+		const SlotRole* roles = SLOT_ROLES[cols.kinds[n]];
+		for (unsigned int s = 0; s < 3; ++s)
+		{
+			if (roles[s] == SLOT_NODE && cols.slots[s][n] != NODE_NONE)
+			{
+				f(cols.slots[s][n]);
+			}
+			else if (roles[s] == SLOT_LIST)
+			{
+				const NodeIndex* list = GetList(n, s);
+				for (unsigned int i = 0, size = GetListSize(n, s); i < size; ++i)
+					f(list[i]);
+			}
+		}
+	};
+
+	void Dump(ostream& os, const SymbolTable& symbols) const;
+};
+
+#endif
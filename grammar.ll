@@ -0,0 +1,175 @@
+# Grammar for TableParser. llgen turns it into the LL(1) tables in
+# ll_table.h and ll_table.cpp as part of the build.
+#
+#   name : symbols | symbols ;    an empty alternative derives nothing
+#   'if' '+='                     keyword and operator tokens
+#   ID INT FLOAT STRING EOL EOF   the other tokens and the end of input
+#   @name                         an action on the value stack, see ll_parser.cpp
+#
+# Where a token can both continue a rule and follow it, the rule takes
+# it, as the loops in Parser do. After an error, parsing goes on as in
+# Parser's panic mode up to the end of the line. A statement list named
+# by %sync that fails takes the line as a statement that failed.
+#
+# An error at a rule is reported with what %expect gives for it, which
+# is what Parser reports in its place; see TableParser::Expect for the
+# end of input. A rule that can be empty and has none ends instead, like
+# a loop in Parser, and the error is found by what follows.
+#
+# The value stack starts out holding the program node.
+
+%sync program block then else_block
+
+%expect "variable name" program block then else_block assign expr logic compare sum product
+%expect "variable name" unary primary retval params args items pairs
+%expect "variable name" elements elements_tail elements_next mapping mapping_tail mapping_next
+%expect "variable name" arguments arguments_tail arguments_next
+%expect "statement" statement ifstat funcdef forloop whileloop
+%expect "token" iftail
+%expect "function name" function_name
+%expect "iterator name" iterator_name
+%expect "attribute name" attribute_name
+
+program : EOL program | statement @stat program | EOF ;
+block : EOL block | statement @stat block | ;
+then : EOL then | statement @stat then | ;
+else_block : EOL else_block | statement @else_stat else_block | ;
+
+statement
+	: ifstat
+	| funcdef
+	| forloop
+	| whileloop
+	| 'return' @return retval EOL
+	| 'break' @break EOL
+	| 'continue' @continue EOL
+	| assign EOL
+	;
+
+ifstat : 'if' @if expr @cond EOL then iftail ;
+iftail
+	: 'elif' @if expr @cond EOL then iftail @elif
+	| 'else' EOL else_block 'end' EOL
+	| 'end' EOL
+	;
+funcdef : 'def' @function function_name '(' params ')' EOL block 'end' EOL ;
+function_name : ID @name ;
+params : EOL params | arguments @set_elements | ;
+forloop : 'for' @for iterator_name 'in' expr @iter_list EOL block 'end' EOL ;
+iterator_name : ID @name ;
+whileloop : 'while' @while expr @cond EOL block 'end' EOL ;
+retval : expr @set_return | ;
+
+# The target is checked before the operator is taken, so that an error
+# points at the operator.
+assign : expr assign_tail ;
+assign_tail
+	: @target '=' @op assign @assign
+	| @target '+=' @op assign @assign
+	| @target '-=' @op assign @assign
+	| @target '*=' @op assign @assign
+	| @target '/=' @op assign @assign
+	| @target '%=' @op assign @assign
+	| @target '&=' @op assign @assign
+	| @target '|=' @op assign @assign
+	| @target '^=' @op assign @assign
+	| @target '~=' @op assign @assign
+	|
+	;
+
+expr : logic bool_tail ;
+bool_tail
+	: '&&' @op logic @bool bool_tail
+	| '||' @op logic @bool bool_tail
+	|
+	;
+logic : compare logic_tail ;
+logic_tail
+	: '&' @op compare @logic logic_tail
+	| '|' @op compare @logic logic_tail
+	| '^' @op compare @logic logic_tail
+	|
+	;
+compare : sum compare_tail ;
+compare_tail
+	: '==' @op sum @compare compare_tail
+	| '!=' @op sum @compare compare_tail
+	| '>' @op sum @compare compare_tail
+	| '>=' @op sum @compare compare_tail
+	| '<' @op sum @compare compare_tail
+	| '<=' @op sum @compare compare_tail
+	|
+	;
+sum : product sum_tail ;
+sum_tail
+	: '+' @op product @sum sum_tail
+	| '-' @op product @sum sum_tail
+	|
+	;
+product : unary product_tail ;
+product_tail
+	: '*' @op unary @product product_tail
+	| '/' @op unary @product product_tail
+	| '%' @op unary @product product_tail
+	|
+	;
+
+unary
+	: '++' @op unary @prefix
+	| '--' @op unary @prefix
+	| '+' @op unary @prefix
+	| '-' @op unary @prefix
+	| '!' @op unary @prefix
+	| '~' @op unary @prefix
+	| primary post_tail
+	;
+post_tail
+	: '++' @postfix post_tail
+	| '--' @postfix post_tail
+	| '.' @invoke attribute_name post_tail
+	| '(' @call args ')' post_tail
+	| '[' @index expr @set_index ']' post_tail
+	|
+	;
+attribute_name : ID @attr ;
+args : EOL args | arguments @set_elements | ;
+
+primary
+	: '(' @op expr ')' @paren
+	| ID @id
+	| STRING @string
+	| INT @int
+	| FLOAT @float
+	| '[' @list items ']'
+	| '{' @dict pairs '}'
+	;
+items : EOL items | elements @set_elements | ;
+pairs : EOL pairs | mapping @set_mapping | ;
+
+# Commas between elements may be left out, and one may trail. The
+# elements of calls and parameters are a rule of their own, so that like
+# those of lists they end only at their own closing bracket.
+elements : @elements expr @element elements_tail ;
+elements_tail
+	: EOL elements_tail
+	| ',' elements_next
+	| expr @element elements_tail
+	|
+	;
+elements_next : EOL elements_next | expr @element elements_tail | ;
+arguments : @elements expr @element arguments_tail ;
+arguments_tail
+	: EOL arguments_tail
+	| ',' arguments_next
+	| expr @element arguments_tail
+	|
+	;
+arguments_next : EOL arguments_next | expr @element arguments_tail | ;
+mapping : @mapping expr ':' expr @pair mapping_tail ;
+mapping_tail
+	: EOL mapping_tail
+	| ',' mapping_next
+	| expr ':' expr @pair mapping_tail
+	|
+	;
+mapping_next : EOL mapping_next | expr ':' expr @pair mapping_tail | ;
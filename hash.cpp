@@ -0,0 +1,99 @@
+#include "hash.h"
+#include <cstring>
+
+static const unsigned long long PRIME1 = 0x9E3779B185EBCA87ull;
+static const unsigned long long PRIME2 = 0xC2B2AE3D27D4EB4Full;
+static const unsigned long long PRIME3 = 0x165667B19E3779F9ull;
+static const unsigned long long PRIME4 = 0x85EBCA77C2B2AE63ull;
+static const unsigned long long PRIME5 = 0x27D4EB2F165667C5ull;
+
+static inline unsigned long long Rotate(unsigned long long x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline unsigned long long Read64(const unsigned char* p)
+{
+	unsigned long long v;
+	memcpy(&v, p, 8);
+	return v;
+}
+
+static inline unsigned int Read32(const unsigned char* p)
+{
+	unsigned int v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static inline unsigned long long Round(unsigned long long acc, unsigned long long input)
+{
+	acc += input * PRIME2;
+	acc = Rotate(acc, 31);
+	return acc * PRIME1;
+}
+
+static inline unsigned long long Merge(unsigned long long acc, unsigned long long v)
+{
+	acc ^= Round(0, v);
+	return acc * PRIME1 + PRIME4;
+}
+
+unsigned long long HashBytes(const void* data, size_t size, unsigned long long seed)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	const unsigned char* end = p + size;
+	unsigned long long h;
+
+	if (size >= 32)
+	{
+		unsigned long long v1 = seed + PRIME1 + PRIME2;
+		unsigned long long v2 = seed + PRIME2;
+		unsigned long long v3 = seed;
+		unsigned long long v4 = seed - PRIME1;
+		do
+		{
+			v1 = Round(v1, Read64(p));
+			v2 = Round(v2, Read64(p + 8));
+			v3 = Round(v3, Read64(p + 16));
+			v4 = Round(v4, Read64(p + 24));
+			p += 32;
+		} while(p + 32 <= end);
+		h = Rotate(v1, 1) + Rotate(v2, 7) + Rotate(v3, 12) + Rotate(v4, 18);
+		h = Merge(h, v1);
+		h = Merge(h, v2);
+		h = Merge(h, v3);
+		h = Merge(h, v4);
+	}
+	else
+	{
+		h = seed + PRIME5;
+	}
+	h += size;
+
+	while(p + 8 <= end)
+	{
+		h ^= Round(0, Read64(p));
+		h = Rotate(h, 27) * PRIME1 + PRIME4;
+		p += 8;
+	}
+	if (p + 4 <= end)
+	{
+		h ^= Read32(p) * PRIME1;
+		h = Rotate(h, 23) * PRIME2 + PRIME3;
+		p += 4;
+	}
+	while(p < end)
+	{
+		h ^= *p * PRIME5;
+		h = Rotate(h, 11) * PRIME1;
+		++p;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+	return h;
+}
@@ -0,0 +1,10 @@
+#ifndef _HASH_H_
+#define _HASH_H_
+
+#include <cstddef>
+using namespace std;
+
+// XXH64 over a byte range; stable across runs, so it can key files on disk.
+unsigned long long HashBytes(const void* data, size_t size, unsigned long long seed = 0);
+
+#endif
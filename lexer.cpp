@@ -1,605 +1,759 @@
 #include "lexer.h"
+#include "mapped_file.h"
+#include "scan.h"
+#include "thread_pool.h"
+#include "symbol_table.h"
+#include "token_cache.h"
+#include <sstream>
+#include <algorithm>
+#include <charconv>
 
-bool Lexer::MatchEOL()
+enum CharClass : unsigned char {
+	CLASS_UNKNOWN = 0, CLASS_BLANK, CLASS_EOL, CLASS_COMMENT, CLASS_QUOTE,
+	CLASS_DIGIT, CLASS_ID, CLASS_OPERATOR
+};
+
+struct Operator
 {
-	char c = in.peek();
-	return (c == '\n' || c == EOF);
+	const char* text;
+	TokenType type;
+};
+
+#define OPERATOR_ENTRY(s, t) { s, t },
+constexpr Operator OPERATORS[] = { OPERATOR_LIST(OPERATOR_ENTRY) };
+#undef OPERATOR_ENTRY
+
+constexpr unsigned int OPERATOR_COUNT = sizeof(OPERATORS) / sizeof(OPERATORS[0]);
+
+const char* TokenName(TokenType type)
+{
+#define NAME_CASE(s, t) case t: return s;
+	switch(type)
+	{
+	KEYWORD_LIST(NAME_CASE)
+	OPERATOR_LIST(NAME_CASE)
+	case TOKEN_INT: return "int";
+	case TOKEN_FLOAT: return "float";
+	case TOKEN_STRING: return "string";
+	case TOKEN_ID: return "id";
+	case TOKEN_EOL: return "eol";
+	default: return "unknown";
+	}
+#undef NAME_CASE
 }
 
-bool Lexer::MatchIdFirst()
+constexpr unsigned int CountOperatorChars(unsigned int pos)
 {
-	char c = in.peek();
-	return ((c >= 'a' && c <= 'z')
-		|| (c >= 'A' && c <= 'Z')
-		|| c == '_');
+	bool seen[256] = {};
+	unsigned int n = 0;
+	for (unsigned int i = 0; i < OPERATOR_COUNT; ++i)
+	{
+		unsigned char c = OPERATORS[i].text[0];
+		if (pos == 1)
+		{
+			c = OPERATORS[i].text[1];
+		}
+		if (c != 0 && !seen[c])
+		{
+			seen[c] = true;
+			++n;
+		}
+	}
+	return n;
+}
+
+constexpr unsigned int OPERATOR_STATES = CountOperatorChars(0);
+constexpr unsigned int OPERATOR_FOLLOWS = CountOperatorChars(1) + 1;
+
+// char_class sends every byte to one scanner branch; an operator's first
+// byte maps to CLASS_OPERATOR + its DFA state, and pair[state][follow[c]]
+// is the two-character token (or TOKEN_UNKNOWN) when c comes next.
+struct ScanTable
+{
+	unsigned char char_class[256];
+	unsigned char follow[256];
+	TokenType single[OPERATOR_STATES];
+	TokenType pair[OPERATOR_STATES][OPERATOR_FOLLOWS];
+};
+
+constexpr ScanTable BuildScanTable()
+{
+	ScanTable t = {};
+
+	t.char_class[(unsigned char)' '] = CLASS_BLANK;
+	t.char_class[(unsigned char)'\t'] = CLASS_BLANK;
+	t.char_class[(unsigned char)'\r'] = CLASS_BLANK;
+	t.char_class[(unsigned char)'\f'] = CLASS_BLANK;
+	t.char_class[(unsigned char)'\n'] = CLASS_EOL;
+	t.char_class[(unsigned char)'#'] = CLASS_COMMENT;
+	t.char_class[(unsigned char)'\''] = CLASS_QUOTE;
+	t.char_class[(unsigned char)'\"'] = CLASS_QUOTE;
+	t.char_class[(unsigned char)'_'] = CLASS_ID;
+	for (int c = '0'; c <= '9'; ++c)
+		t.char_class[c] = CLASS_DIGIT;
+	for (int c = 'a'; c <= 'z'; ++c)
+		t.char_class[c] = CLASS_ID;
+	for (int c = 'A'; c <= 'Z'; ++c)
+		t.char_class[c] = CLASS_ID;
+
+	for (unsigned int i = 0; i < OPERATOR_STATES; ++i)
+		for (unsigned int j = 0; j < OPERATOR_FOLLOWS; ++j)
+			t.pair[i][j] = TOKEN_UNKNOWN;
+
+	unsigned int states = 0;
+	unsigned int follows = 0;
+	for (unsigned int i = 0; i < OPERATOR_COUNT; ++i)
+	{
+		unsigned char c0 = OPERATORS[i].text[0];
+		unsigned char c1 = OPERATORS[i].text[1];
+		if (t.char_class[c0] == CLASS_UNKNOWN)
+			t.char_class[c0] = CLASS_OPERATOR + states++;
+		unsigned int state = t.char_class[c0] - CLASS_OPERATOR;
+		if (c1 == 0)
+		{
+			t.single[state] = OPERATORS[i].type;
+		}
+		else
+		{
+			if (t.follow[c1] == 0)
+				t.follow[c1] = ++follows;
+			t.pair[state][t.follow[c1]] = OPERATORS[i].type;
+		}
+	}
+	return t;
 }
 
-bool Lexer::MatchId()
+constexpr ScanTable SCAN_TABLE = BuildScanTable();
+
+void Lexer::Consume()
 {
-	char c = in.peek();
-	return ((c >= 'a' && c <= 'z')
-		|| (c >= 'A' && c <= 'Z')
-		|| (c >= '0' && c <= '9')
-		|| c == '_');
+	cur = scan->skip_blank(cur, end);
 }
 
-bool Lexer::MatchNumber()
+void Lexer::ConsumeComment()
 {
-	char c = in.peek();
-	return (c >= '0' && c <= '9');
+	cur = scan->skip_line(cur, end);
+	if (cur < end)
+		++cur;
 }
 
-bool Lexer::MatchString()
+void Lexer::AddNumber()
 {
-	char c = in.peek();
-	return (c == '\'' || c == '\"');
+	const char* start = cur;
+	TokenType type = TOKEN_INT;
+	while(cur < end && SCAN_TABLE.char_class[(unsigned char)*cur] == CLASS_DIGIT)
+		++cur;
+	if (PeekChar() == '.')
+	{
+		type = TOKEN_FLOAT;
+		do
+		{
+			++cur;
+		} while(cur < end && SCAN_TABLE.char_class[(unsigned char)*cur] == CLASS_DIGIT);
+	}
+
+	TokenLiteral value;
+	value.i = 0;
+	if (type == TOKEN_INT)
+	{
+		if (from_chars(start, cur, value.i).ec != errc())
+			Report(start, "Integer literal is out of range");
+	}
+	else if (cur[-1] == '.')
+	{
+		Report(cur, "Expect digits after \'.\' in number");
+		from_chars(start, cur, value.f);
+	}
+	else if (from_chars(start, cur, value.f).ec != errc())
+	{
+		Report(start, "Float literal is out of range");
+	}
+	AddToken(start, type, tokens.AddLiteral(value));
 }
 
-bool Lexer::MatchOperation()
+void Lexer::AddString()
 {
-	char c = in.peek();
-	return (c == '+' || c == '-' || c == '%'
-		|| c == '*' || c == '/' || c == '.'
-		|| c == '>' || c == '<');
+	TokenType type = TOKEN_STRING;
+	char ter = *cur++;
+	const char* start = cur;
+	cur = scan->skip_string(cur, end, ter);
+	tokens.Add(type, base + (start - src), cur - start, 0);
+	if (cur < end && *cur == ter)
+	{
+		++cur;
+	}
+	else
+	{
+		Report(cur, "Unterminated string");
+	}
 }
 
-bool Lexer::MatchLogicalOperation()
+void Lexer::AddId()
 {
-	char c = in.peek();
-	return (c == '&' || c == '|' || c == '!'
-		|| c == '^' || c == '=' || c == '~');
+	const char* start = cur;
+	cur = scan->skip_id(cur + 1, end);
+	TokenType type = LookupKeyword(start, cur - start);
+	if (type == TOKEN_ID)
+		AddToken(start, type, symbols->Intern(start, cur - start));
+	else
+		AddToken(start, type);
 }
 
-bool Lexer::MatchSymbol()
+void Lexer::AddOperator(unsigned char cls)
 {
-	char c = in.peek();
-	return (c == '(' || c == ')' || c == '['
-		|| c == ']' || c == '{' || c == '}'
-		|| c == ',' || c == ':');
+	const char* start = cur++;
+	unsigned int state = cls - CLASS_OPERATOR;
+	TokenType type = SCAN_TABLE.single[state];
+	if (cur < end)
+	{
+		TokenType pair = SCAN_TABLE.pair[state][SCAN_TABLE.follow[(unsigned char)*cur]];
+		if (pair != TOKEN_UNKNOWN)
+		{
+			type = pair;
+			++cur;
+		}
+	}
+	AddToken(start, type);
 }
 
-bool Lexer::MatchBlank()
+void Lexer::AddEOL()
 {
-	char c = in.peek();
-	return (c == '\r' || c == ' '
-		|| c == '\t' || c == '\f');
+	const char* start = cur++;
+	TokenType type = TOKEN_EOL;
+	AddToken(start, type);
 }
 
-bool Lexer::MatchComment()
+void Lexer::AddToken(const char* start, TokenType type, unsigned int value)
 {
-	char c = in.peek();
-	return (c == '#');
+	tokens.Add(type, base + (start - src), cur - start, value);
 }
 
-void Lexer::Consume()
+void Lexer::Report(const char* p, const char* msg)
 {
-	while(!in.eof() && MatchBlank())
-		in.get();
+	unsigned int offset = base + (p - src);
+	fail = true;
+	errors.push_back(offset);
+	*err << "[Error] " << msg << " at line " << tokens.GetLineAt(offset)
+		<< ", column " << tokens.GetColumnAt(offset) << endl;
 }
 
-void Lexer::ConsumeComment()
+void Lexer::ProcessUnknownToken()
 {
-	while(!in.eof() && !MatchEOL())
-		in.get();
-	in.get();
-	++line;
+	string msg = "Unknown Token \'";
+	msg += *cur;
+	msg += "\' is found";
+	Report(cur++, msg.c_str());
 }
 
-void Lexer::AddNumber()
+Lexer::Lexer()
+	: file(NULL), scan(&GetScanKernels()), stream(NULL), pool(NULL),
+	symbols(&SymbolTable::Global()), err(&cerr), view(&tokens), start(0), stop(~0u), fail(false)
+{}
+
+Lexer::Lexer(const Lexer& whole, TokenIterator first, TokenIterator last)
+	: file(NULL), scan(whole.scan), stream(NULL), pool(NULL),
+	symbols(whole.symbols), err(whole.err), base(whole.base), view(&whole.tokens),
+	start(first), stop(last), fail(false)
 {
-	string buf;
-	TokenType type = TOKEN_INT;
-	while(!in.eof() && MatchNumber())
-		buf.push_back(in.get());
-	if (in.peek() == '.')
-	{
-		type = TOKEN_FLOAT;
-		do
-		{
-			buf.push_back(in.get());
-		} while(!in.eof() && MatchNumber());
-	}
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
+	src = whole.src;
+	cur = whole.end;
+	end = whole.end;
+	limit = whole.end;
+	it = first;
 }
 
-void Lexer::AddString()
+Lexer::Lexer(istream& is)
+	: file(NULL), scan(&GetScanKernels()), stream(NULL), pool(NULL),
+	symbols(&SymbolTable::Global()), err(&cerr), view(&tokens), start(0), stop(~0u), fail(false)
 {
-	string buf;
-	TokenType type = TOKEN_STRING;
-	char ter = in.get();
-	while(!in.eof() && in.peek() != ter)
-		buf.push_back(in.get());
-	in.get();
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
+	char chunk[65536];
+	while(is.read(chunk, sizeof(chunk)) || is.gcount() > 0)
+		buffer.append(chunk, is.gcount());
+	Tokenize(buffer.data(), buffer.data() + buffer.size());
 }
 
-void Lexer::AddId()
+Lexer::Lexer(istream& is, unsigned int lookahead)
+	: file(NULL), scan(&GetScanKernels()), stream(&is), pool(NULL),
+	symbols(&SymbolTable::Global()), err(&cerr), base(0), view(&tokens), start(0),
+	stop(~0u), fail(false)
 {
-	string buf;
-	TokenType type = TOKEN_ID;
-	while(!in.eof() && MatchId())
-		buf.push_back(in.get());
-	if (buf == "for")
-	{
-		type = TOKEN_FOR;
-	}
-	else if (buf == "while")
-	{
-		type = TOKEN_WHILE;
-	}
-	else if (buf == "if")
-	{
-		type = TOKEN_IF;
-	}
-	else if (buf == "else")
-	{
-		type = TOKEN_ELSE;
-	}
-	else if (buf == "elif")
-	{
-		type = TOKEN_ELIF;
-	}
-	else if (buf == "end")
-	{
-		type = TOKEN_END;
-	}
-	else if (buf == "def")
-	{
-		type = TOKEN_DEF;
-	}
-	else if (buf == "break")
-	{
-		type = TOKEN_BREAK;
-	}
-	else if (buf == "return")
+	TokenIterator capacity = 1;
+	while(capacity < lookahead)
+		capacity <<= 1;
+	tokens.SetRing(capacity);
+
+	src = buffer.data();
+	cur = src;
+	end = src;
+	limit = src;
+	it = 0;
+}
+
+Lexer::Lexer(const char* path, ThreadPool* tp, const char* cache)
+	: file(NULL), scan(&GetScanKernels()), stream(NULL), pool(tp),
+	symbols(&SymbolTable::Global()), err(&cerr), view(&tokens), start(0), stop(~0u), fail(false)
+{
+	file = new MappedFile(path);
+	if (file->IsFail())
 	{
-		type = TOKEN_RETURN;
+		fail = true;
+		cerr << "[Error] Can not open file: " << path << endl;
+		return;
 	}
-	else if (buf == "continue")
+	if (!cache)
 	{
-		type = TOKEN_CONTINUE;
+		Tokenize(file->GetData(), file->GetData() + file->GetSize());
+		return;
 	}
-	else if (buf == "in")
+
+	TokenCache tc(cache, file->GetData(), file->GetSize());
+	if (tc.Load(tokens, *symbols))
 	{
-		type = TOKEN_IN;
+		base = 0;
+		src = file->GetData();
+		cur = src + file->GetSize();
+		end = cur;
+		limit = cur;
+		it = 0;
+		tokens.SetSource(src, base);
+		return;
 	}
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
+	Tokenize(file->GetData(), file->GetData() + file->GetSize());
+	// Diagnostics are only printed while lexing, so a file with errors
+	// is never served from the cache.
+	if (!fail)
+		tc.Save(tokens, *symbols);
 }
 
-void Lexer::AddLBrackets()
+Lexer::Lexer(const char* src, size_t size, ThreadPool* tp)
+	: file(NULL), scan(&GetScanKernels()), stream(NULL), pool(tp),
+	symbols(&SymbolTable::Global()), err(&cerr), view(&tokens), start(0), stop(~0u), fail(false)
 {
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_LBRACKETS;
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
+	Tokenize(src, src + size);
 }
 
-void Lexer::AddRBrackets()
+void TokenBuffer::Reserve(size_t n)
 {
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_RBRACKETS;
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
+	types.reserve(n);
+	offsets.reserve(n);
+	lengths.reserve(n);
+	values.reserve(n);
+	literals.reserve(n / 8);
 }
 
-void Lexer::AddLMBrackets()
+void TokenBuffer::Resize(TokenIterator n)
 {
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_LMBRACKETS;
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
+	types.resize(n);
+	offsets.resize(n);
+	lengths.resize(n);
+	values.resize(n);
+	count = n;
 }
 
-void Lexer::AddRMBrackets()
+void TokenBuffer::ResizeLiterals(unsigned int n)
 {
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_RMBRACKETS;
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
+	literals.resize(n);
+	literal_count = n;
 }
 
-void Lexer::AddLBBrackets()
+void TokenBuffer::Copy(TokenIterator at, const TokenBuffer& other, TokenIterator n)
 {
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_LBBRACKETS;
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
+	copy(other.types.begin(), other.types.begin() + n, types.begin() + at);
+	copy(other.offsets.begin(), other.offsets.begin() + n, offsets.begin() + at);
+	copy(other.lengths.begin(), other.lengths.begin() + n, lengths.begin() + at);
+	copy(other.values.begin(), other.values.begin() + n, values.begin() + at);
 }
 
-void Lexer::AddRBBrackets()
+template<class T>
+static void Splice(vector<T>& v, TokenIterator first, TokenIterator removed,
+	const vector<T>& from, TokenIterator inserted)
 {
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_LBBRACKETS;
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
+	size_t tail = v.size() - first - removed;
+	if (inserted > removed)
+		v.resize(v.size() + inserted - removed);
+	if (inserted != removed && tail > 0)
+		memmove(&v[first + inserted], &v[first + removed], tail * sizeof(T));
+	if (inserted < removed)
+		v.resize(v.size() - (removed - inserted));
+	copy(from.begin(), from.begin() + inserted, v.begin() + first);
 }
 
-void Lexer::AddComma()
+void TokenBuffer::Replace(TokenIterator first, TokenIterator removed,
+	const TokenBuffer& other, TokenIterator inserted, int offset_delta)
 {
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_COMMA;
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
+	Splice(types, first, removed, other.types, inserted);
+	Splice(offsets, first, removed, other.offsets, inserted);
+	Splice(lengths, first, removed, other.lengths, inserted);
+	Splice(values, first, removed, other.values, inserted);
+
+	count = (TokenIterator)types.size();
+	if (offset_delta != 0)
+	{
+		for (TokenIterator i = first + inserted; i < count; ++i)
+			offsets[i] += offset_delta;
+	}
 }
 
-void Lexer::AddColon()
+TokenIterator TokenBuffer::Find(unsigned int offset) const
 {
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_COLON;
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
+	return (TokenIterator)(lower_bound(offsets.begin(), offsets.begin() + count, offset)
+		- offsets.begin());
 }
 
-void Lexer::AddPlus()
+void TokenBuffer::SetRing(TokenIterator capacity)
 {
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_PLUS;
-	if (in.peek() == '+')
-	{
-		buf[1] = in.get();
-		type = TOKEN_INC;
-	}
-	else if (in.peek() == '=')
-	{
-		buf[1] = in.get();
-		type = TOKEN_PLUS_ASSIGN;
-	}
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
+	mask = capacity - 1;
+	Reserve(capacity);
 }
 
-void Lexer::AddMinus()
+void Lexer::Tokenize(const char* begin, const char* finish)
 {
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_MINUS;
-	if (in.peek() == '-')
-	{
-		buf[1] = in.get();
-		type = TOKEN_DEC;
-	}
-	else if (in.peek() == '=')
-	{
-		buf[1] = in.get();
-		type = TOKEN_MINUS_ASSIGN;
-	}
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
+	base = 0;
+	src = begin;
+	it = 0;
+	tokens.SetSource(src, base);
+
+	if (pool && pool->GetSize() > 1 && (size_t)(finish - begin) >= PARALLEL_MIN_SIZE)
+		TokenizeParallel(begin, finish);
+	else
+		TokenizeRange(begin, finish);
 }
 
-void Lexer::AddMulti()
+void Lexer::TokenizeRange(const char* begin, const char* finish)
 {
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_MULTI;
-	if (in.peek() == '=')
-	{
-		buf[1] = in.get();
-		type = TOKEN_MULTI_ASSIGN;
-	}
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
+	cur = begin;
+	end = finish;
+	limit = finish;
+
+	tokens.Reserve((finish - begin) / 4 + 1);
+
+	while(cur < end)
+		Step();
+
+	AddToken(cur, TOKEN_EOL);
 }
 
-void Lexer::AddDiv()
+void Lexer::TokenizeParallel(const char* begin, const char* finish)
 {
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_DIV;
-	if (in.peek() == '=')
+	size_t size = finish - begin;
+	size_t n = pool->GetSize() * 4;
+	if (n > size / PARALLEL_MIN_CHUNK)
+		n = size / PARALLEL_MIN_CHUNK;
+
+	// Split right after a newline so that every chunk starts in the same
+	// scanner state as the serial lexer would be in at that point.
+	vector<const char*> bounds(1, begin);
+	for (size_t i = 1; i < n; ++i)
 	{
-		buf[1] = in.get();
-		type = TOKEN_DIV_ASSIGN;
+		const char* p = begin + size * i / n;
+		if (p < bounds.back())
+			continue;
+		p = scan->skip_line(p, finish);
+		if (p == finish)
+			break;
+		bounds.push_back(p + 1);
 	}
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
-}
+	bounds.push_back(finish);
+	n = bounds.size() - 1;
 
-void Lexer::AddMod()
-{
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_MOD;
-	if (in.peek() == '=')
+	vector<Lexer*> parts(n);
+	vector<ostringstream> messages(n);
+	for (size_t i = 0; i < n; ++i)
 	{
-		buf[1] = in.get();
-		type = TOKEN_MOD_ASSIGN;
+		Lexer* part = new Lexer();
+		part->scan = scan;
+		part->symbols = new SymbolTable();
+		part->err = &messages[i];
+		part->base = 0;
+		part->src = src;
+		part->tokens.SetSource(src, 0);
+		parts[i] = part;
+		pool->Submit([part, &bounds, i]()
+		{
+			part->TokenizeRange(bounds[i], bounds[i + 1]);
+		});
 	}
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
-}
+	pool->Wait();
 
-void Lexer::AddAnd()
-{
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_BIT_AND;
-	if (in.peek() == '=')
+	// Every chunk but the last ends with the synthetic end-of-input EOL,
+	// which the serial lexer would not produce there.
+	vector<TokenIterator> at(n + 1, 0);
+	vector<unsigned int> literal_at(n + 1, 0);
+	for (size_t i = 0; i < n; ++i)
 	{
-		buf[1] = in.get();
-		type = TOKEN_BIT_AND_ASSIGN;
+		TokenIterator count = parts[i]->tokens.GetSize();
+		at[i + 1] = at[i] + (i + 1 < n ? count - 1 : count);
+		literal_at[i + 1] = literal_at[i] + parts[i]->tokens.GetLiteralCount();
 	}
-	else if (in.peek() == '&')
+	// Identifiers were interned into per-chunk tables; map them onto
+	// the shared table while copying.
+	vector<vector<unsigned int> > remap(n);
+	for (size_t i = 0; i < n; ++i)
 	{
-		buf[1] = in.get();
-		type = TOKEN_AND;
+		SymbolTable* local = parts[i]->symbols;
+		remap[i].resize(local->GetSize());
+		for (unsigned int id = 0; id < local->GetSize(); ++id)
+			remap[i][id] = symbols->Intern(local->GetName(id));
 	}
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
-}
 
-void Lexer::AddOr()
-{
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_BIT_OR;
-	if (in.peek() == '=')
+	tokens.Resize(at[n]);
+	tokens.ResizeLiterals(literal_at[n]);
+	for (size_t i = 0; i < n; ++i)
 	{
-		buf[1] = in.get();
-		type = TOKEN_BIT_OR_ASSIGN;
-	}
-	else if (in.peek() == '|')
-	{
-		buf[1] = in.get();
-		type = TOKEN_OR;
+		pool->Submit([this, &parts, &at, &literal_at, &remap, i]()
+		{
+			const TokenBuffer& part = parts[i]->tokens;
+			tokens.Copy(at[i], part, at[i + 1] - at[i]);
+			for (unsigned int k = 0; k < part.GetLiteralCount(); ++k)
+				tokens.SetLiteral(literal_at[i] + k, part.GetLiteral(k));
+			for (TokenIterator k = at[i]; k < at[i + 1]; ++k)
+			{
+				TokenType type = tokens.GetType(k);
+				if (type == TOKEN_ID)
+					tokens.SetValue(k, remap[i][tokens.GetValue(k)]);
+				else if (type == TOKEN_INT || type == TOKEN_FLOAT)
+					tokens.SetValue(k, literal_at[i] + tokens.GetValue(k));
+			}
+		});
 	}
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
-}
+	pool->Wait();
 
-void Lexer::AddXor()
-{
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_BIT_XOR;
-	if (in.peek() == '=')
+	for (size_t i = 0; i < n; ++i)
 	{
-		buf[1] = in.get();
-		type = TOKEN_BIT_XOR_ASSIGN;
+		*err << messages[i].str();
+		fail = fail || parts[i]->fail;
+		errors.insert(errors.end(), parts[i]->errors.begin(), parts[i]->errors.end());
 	}
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
-}
+	cur = finish;
+	end = finish;
+	limit = finish;
 
-void Lexer::AddNot()
-{
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_NOT;
-	if (in.peek() == '=')
+	for (size_t i = 0; i < n; ++i)
 	{
-		buf[1] = in.get();
-		type = TOKEN_NOT_EQUAL;
+		delete parts[i]->symbols;
+		delete parts[i];
 	}
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
 }
 
-void Lexer::AddMore()
+void Lexer::Step()
 {
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_MORE;
-	if (in.peek() == '=')
+	unsigned char cls = SCAN_TABLE.char_class[(unsigned char)*cur];
+	switch(cls)
 	{
-		buf[1] = in.get();
-		type = TOKEN_GE;
+	case CLASS_BLANK:
+		Consume();
+		break;
+	case CLASS_EOL:
+		AddEOL();
+		break;
+	case CLASS_COMMENT:
+		ConsumeComment();
+		break;
+	case CLASS_QUOTE:
+		AddString();
+		break;
+	case CLASS_DIGIT:
+		AddNumber();
+		break;
+	case CLASS_ID:
+		AddId();
+		break;
+	case CLASS_UNKNOWN:
+		ProcessUnknownToken();
+		break;
+	default:
+		AddOperator(cls);
+		break;
 	}
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
 }
 
-void Lexer::AddLess()
+void Lexer::Pull()
 {
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_LESS;
-	if (in.peek() == '=')
+	while(stream && it >= tokens.GetSize())
 	{
-		buf[1] = in.get();
-		type = TOKEN_LE;
+		if (cur < limit)
+			Step();
+		else
+			Refill();
 	}
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
 }
 
-void Lexer::AddBitNot()
+void Lexer::Refill()
 {
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_BIT_NOT;
-	if (in.peek() == '=')
+	const size_t chunk = 65536;
+
+	if (stream->eof())
 	{
-		buf[1] = in.get();
-		type = TOKEN_BIT_NOT_ASSIGN;
+		if (limit < end)
+		{
+			limit = end;
+			return;
+		}
+		AddToken(cur, TOKEN_EOL);
+		stream = NULL;
+		return;
 	}
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
-}
 
-void Lexer::AddAssign()
-{
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_ASSIGN;
-	if (in.peek() == '=')
+	unsigned int keep = base + (cur - src);
+	if (tokens.GetSize() > tokens.GetFirst())
+		keep = tokens.GetOffset(tokens.GetFirst());
+	size_t pos = (cur - src) - (keep - base);
+	tokens.IndexLines(keep);
+	tokens.DropLines(keep);
+	buffer.erase(0, keep - base);
+	base = keep;
+
+	size_t eol = string::npos;
+	while(eol == string::npos && !stream->eof())
 	{
-		buf[1] = in.get();
-		type = TOKEN_EQUAL;
+		size_t old = buffer.size();
+		buffer.resize(old + chunk);
+		stream->read(&buffer[old], chunk);
+		buffer.resize(old + stream->gcount());
+		for (size_t i = buffer.size(); i > old; --i)
+		{
+			if (buffer[i - 1] == '\n')
+			{
+				eol = i;
+				break;
+			}
+		}
 	}
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
-}
 
-void Lexer::AddInvoke()
-{
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_INVOKE;
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
+	src = buffer.data();
+	cur = src + pos;
+	end = src + buffer.size();
+	limit = (stream->eof() || eol == string::npos) ? end : src + eol;
+	tokens.SetSource(src, base);
 }
 
-void Lexer::AddEOL()
+void Lexer::SetPosition(TokenIterator i)
 {
-	char buf[4] = {0};
-	buf[0] = in.get();
-	TokenType type = TOKEN_EOL;
-	Token* t = new Token(buf, type, line);
-	token_list.push_back(t);
-	++line;
+	if (i < tokens.GetFirst())
+	{
+		fail = true;
+		cerr << "[Error] Can not rewind past the lexer lookahead window"
+			<< endl;
+		i = tokens.GetFirst();
+	}
+	it = i;
 }
 
-void Lexer::ProcessUnknownToken()
-{
-	fail = true;
-	cerr << "[Error] Unknown Token \'" << in.get()
-		<< "\' is found at line: " << line << endl;
-}
 
-Lexer::Lexer(istream& is) : in(is)
+bool Lexer::Edit(unsigned int offset, unsigned int length, string_view text, TokenEdit* change)
 {
-	line = 1;
-	fail = false;
+	// A lexer that streamed its input keeps only a window of it, whose
+	// token indices no longer match the source.
+	unsigned int size = end - src;
+	if (stream || base != 0 || tokens.GetFirst() != 0 || offset > size || length > size - offset)
+		return false;
 
-	while(!in.eof())
+	if (src != buffer.data())
 	{
-		char c = in.peek();
-		if (MatchBlank())
-		{
-			Consume();
-		}
-		else if (MatchComment())
-		{
-			ConsumeComment();
-		}
-		else if (MatchNumber())
-		{
-			AddNumber();
-		}
-		else if (MatchString())
-		{
-			AddString();
-		}
-		else if (MatchIdFirst())
-		{
-			AddId();
-		}
-		else if (MatchSymbol())
+		buffer.assign(src, size);
+		if (file)
 		{
-			switch(c)
-			{
-			case '(':
-				AddLBrackets();
-				break;
-			case ')':
-				AddRBrackets();
-				break;
-			case '[':
-				AddLMBrackets();
-				break;
-			case ']':
-				AddRMBrackets();
-				break;
-			case '{':
-				AddLBBrackets();
-				break;
-			case '}':
-				AddRBBrackets();
-				break;
-			case ',':
-				AddComma();
-				break;
-			case ':':
-				AddColon();
-				break;
-			}
+			delete file;
+			file = NULL;
 		}
-		else if (MatchOperation())
-		{
-			switch(c)
-			{
-			case '+':
-				AddPlus();
-				break; 
-			case '-':
-				AddMinus();
-				break; 
-			case '*':
-				AddMulti();
-				break; 
-			case '/':
-				AddDiv();
-				break; 
-			case '%':
-				AddMod();
-				break;
-			case '.':
-				AddInvoke();
-				break;
-			case '>':
-				AddMore();
-				break;
-			case '<':
-				AddLess();
-				break;
-			}
-		}
-		else if (MatchLogicalOperation())
-		{
-			switch(c)
-			{
-			case '&':
-				AddAnd();
-				break;
-			case '|':
-				AddOr();
-				break;
-			case '^':
-				AddXor();
-				break;
-			case '!':
-				AddNot();
-				break;
-			case '=':
-				AddAssign();
-				break;
-			case '~':
-				AddBitNot();
-				break;
-			}
-		}
-		else if (MatchEOL())
-		{
-			AddEOL();
-		}
-		else
+	}
+
+	// Tokens never span lines, so only the lines touched by the edit
+	// need to be lexed again.
+	const char* data = buffer.data();
+	unsigned int line_begin = offset;
+	while(line_begin > 0 && data[line_begin - 1] != '\n')
+		--line_begin;
+	unsigned int line_end = scan->skip_line(data + offset + length, data + size) - data;
+	if (line_end < size)
+		++line_end;
+
+	TokenIterator first = tokens.Find(line_begin);
+	TokenIterator last = (line_end < size ? tokens.Find(line_end) : tokens.GetSize());
+
+	buffer.replace(offset, length, text.data(), text.size());
+	int delta = (int)text.size() - (int)length;
+	src = buffer.data();
+	cur = src + buffer.size();
+	end = cur;
+	limit = cur;
+	tokens.SetSource(src, 0);
+	tokens.TruncateLines(line_begin);
+
+	Lexer part;
+	part.scan = scan;
+	part.symbols = symbols;
+	part.err = err;
+	part.base = 0;
+	part.src = src;
+	part.tokens.SetSource(src, 0);
+	part.TokenizeRange(src + line_begin, src + line_end + delta);
+	TokenIterator inserted = part.tokens.GetSize();
+	if (line_end < size)
+		--inserted;
+
+	// Literal slots of the replaced tokens are handed to the new ones, so
+	// that editing does not grow the literal table.
+	for (TokenIterator k = first; k < last; ++k)
+	{
+		TokenType type = tokens.GetType(k);
+		if (type == TOKEN_INT || type == TOKEN_FLOAT)
+			free_literals.push_back(tokens.GetValue(k));
+	}
+	for (TokenIterator k = 0; k < inserted; ++k)
+	{
+		TokenType type = part.tokens.GetType(k);
+		if (type != TOKEN_INT && type != TOKEN_FLOAT)
+			continue;
+		TokenLiteral v = part.tokens.GetLiteral(part.tokens.GetValue(k));
+		if (free_literals.empty())
 		{
-			ProcessUnknownToken();
+			part.tokens.SetValue(k, tokens.AddLiteral(v));
+			continue;
 		}
+		unsigned int slot = free_literals.back();
+		free_literals.pop_back();
+		tokens.SetLiteral(slot, v);
+		part.tokens.SetValue(k, slot);
+	}
+
+	// Errors in the lexed lines are replaced by the ones found now; those
+	// after them move with their text. They stay in source order.
+	vector<unsigned int> kept;
+	size_t k = 0;
+	for (; k < errors.size() && errors[k] < line_begin; ++k)
+		kept.push_back(errors[k]);
+	kept.insert(kept.end(), part.errors.begin(), part.errors.end());
+	for (; k < errors.size(); ++k)
+	{
+		if (errors[k] >= line_end)
+			kept.push_back(errors[k] + delta);
+	}
+	errors.swap(kept);
+	fail = !errors.empty();
+	tokens.Replace(first, last - first, part.tokens, inserted, delta);
+
+	if (it >= last)
+		it = it + inserted - (last - first);
+	else if (it > first)
+		it = first;
+
+	if (change)
+	{
+		change->first = first;
+		change->removed = last - first;
+		change->inserted = inserted;
+		change->begin = line_begin;
+		change->end = line_end;
+		change->delta = delta;
 	}
+	return true;
 }
 
 Lexer::~Lexer()
 {
-	for (list<Token*>::iterator it = token_list.begin();
-		it != token_list.end(); ++it)
+	if (file)
 	{
-		if (*it)
-		{
-			delete *it;
-		}
+		delete file;
 	}
-}
+}
\ No newline at end of file
@@ -3,11 +3,19 @@
 
 #include <iostream>
 #include <fstream>
-#include <list>
+#include <vector>
 #include <string>
+#include <string_view>
+#include <cstring>
+#include "line_index.h"
 using namespace std;
 
-enum TokenType {
+class MappedFile;
+class ThreadPool;
+class SymbolTable;
+struct ScanKernels;
+
+enum TokenType : unsigned char {
 	TOKEN_INT = 0, TOKEN_FLOAT, TOKEN_STRING, TOKEN_ID,
 	TOKEN_FOR, TOKEN_WHILE, TOKEN_IF, TOKEN_ELSE, TOKEN_ELIF,
 	TOKEN_END, TOKEN_RETURN, TOKEN_BREAK, TOKEN_CONTINUE,
@@ -19,7 +27,7 @@ enum TokenType {
 	TOKEN_PLUS_ASSIGN, TOKEN_MINUS_ASSIGN, TOKEN_MULTI_ASSIGN,
 	TOKEN_DIV_ASSIGN, TOKEN_MOD_ASSIGN,
 	TOKEN_INC, TOKEN_DEC,
-	TOKEN_BIT_AND, TOKEN_BIT_OR, TOKEN_BIT_XOR, TOKEN_BIT_NOT
+	TOKEN_BIT_AND, TOKEN_BIT_OR, TOKEN_BIT_XOR, TOKEN_BIT_NOT,
 	TOKEN_BIT_AND_ASSIGN, TOKEN_BIT_OR_ASSIGN,
 	TOKEN_BIT_XOR_ASSIGN, TOKEN_BIT_NOT_ASSIGN,
 	TOKEN_ASSIGN, TOKEN_INVOKE,
@@ -28,45 +36,283 @@ enum TokenType {
 	TOKEN_EOL, TOKEN_UNKNOWN
 };
 
+#define KEYWORD_LIST(X) \
+	X("for", TOKEN_FOR) \
+	X("while", TOKEN_WHILE) \
+	X("if", TOKEN_IF) \
+	X("else", TOKEN_ELSE) \
+	X("elif", TOKEN_ELIF) \
+	X("end", TOKEN_END) \
+	X("def", TOKEN_DEF) \
+	X("break", TOKEN_BREAK) \
+	X("return", TOKEN_RETURN) \
+	X("continue", TOKEN_CONTINUE) \
+	X("in", TOKEN_IN)
+
+struct Keyword
+{
+	const char* text;
+	unsigned int length;
+	TokenType type;
+};
+
+#define KEYWORD_ENTRY(s, t) { s, sizeof(s) - 1, t },
+constexpr Keyword KEYWORDS[] = { KEYWORD_LIST(KEYWORD_ENTRY) };
+#undef KEYWORD_ENTRY
+
+constexpr unsigned int KEYWORD_COUNT = sizeof(KEYWORDS) / sizeof(KEYWORDS[0]);
+constexpr unsigned int KEYWORD_BITS = 5;
+constexpr unsigned int KEYWORD_SLOTS = 1 << KEYWORD_BITS;
+
+// Keywords are told apart by first char, last char and length; the
+// multiplier is searched at compile time so that no two share a slot.
+constexpr unsigned int KeywordHash(const char* s, unsigned int len, unsigned int seed)
+{
+	return ((((unsigned char)s[0] << 16) | ((unsigned char)s[len - 1] << 8) | len)
+		* seed) >> (32 - KEYWORD_BITS);
+}
+
+struct KeywordTable
+{
+	unsigned int seed;
+	unsigned int min_length;
+	unsigned int max_length;
+	unsigned char slots[KEYWORD_SLOTS];
+};
+
+constexpr KeywordTable BuildKeywordTable()
+{
+	KeywordTable table = {};
+	table.min_length = ~0u;
+	for (unsigned int i = 0; i < KEYWORD_COUNT; ++i)
+	{
+		if (KEYWORDS[i].length < table.min_length)
+			table.min_length = KEYWORDS[i].length;
+		if (KEYWORDS[i].length > table.max_length)
+			table.max_length = KEYWORDS[i].length;
+	}
+
+	for (table.seed = 0x9E3779B1u; ; table.seed += 2)
+	{
+		bool collide = false;
+		for (unsigned int i = 0; i < KEYWORD_SLOTS; ++i)
+			table.slots[i] = 0;
+		for (unsigned int i = 0; i < KEYWORD_COUNT && !collide; ++i)
+		{
+			unsigned int h = KeywordHash(KEYWORDS[i].text, KEYWORDS[i].length, table.seed);
+			collide = (table.slots[h] != 0);
+			table.slots[h] = i + 1;
+		}
+		if (!collide)
+			return table;
+	}
+}
+
+constexpr KeywordTable KEYWORD_TABLE = BuildKeywordTable();
+
+#define OPERATOR_LIST(X) \
+	X("(", TOKEN_LBRACKETS) X(")", TOKEN_RBRACKETS) \
+	X("[", TOKEN_LMBRACKETS) X("]", TOKEN_RMBRACKETS) \
+	X("{", TOKEN_LBBRACKETS) X("}", TOKEN_RBBRACKETS) \
+	X(",", TOKEN_COMMA) X(":", TOKEN_COLON) X(".", TOKEN_INVOKE) \
+	X("+", TOKEN_PLUS) X("++", TOKEN_INC) X("+=", TOKEN_PLUS_ASSIGN) \
+	X("-", TOKEN_MINUS) X("--", TOKEN_DEC) X("-=", TOKEN_MINUS_ASSIGN) \
+	X("*", TOKEN_MULTI) X("*=", TOKEN_MULTI_ASSIGN) \
+	X("/", TOKEN_DIV) X("/=", TOKEN_DIV_ASSIGN) \
+	X("%", TOKEN_MOD) X("%=", TOKEN_MOD_ASSIGN) \
+	X("&", TOKEN_BIT_AND) X("&=", TOKEN_BIT_AND_ASSIGN) X("&&", TOKEN_AND) \
+	X("|", TOKEN_BIT_OR) X("|=", TOKEN_BIT_OR_ASSIGN) X("||", TOKEN_OR) \
+	X("^", TOKEN_BIT_XOR) X("^=", TOKEN_BIT_XOR_ASSIGN) \
+	X("~", TOKEN_BIT_NOT) X("~=", TOKEN_BIT_NOT_ASSIGN) \
+	X("!", TOKEN_NOT) X("!=", TOKEN_NOT_EQUAL) \
+	X("=", TOKEN_ASSIGN) X("==", TOKEN_EQUAL) \
+	X(">", TOKEN_MORE) X(">=", TOKEN_GE) \
+	X("<", TOKEN_LESS) X("<=", TOKEN_LE)
+
+inline TokenType LookupKeyword(const char* s, unsigned int len)
+{
+	if (len < KEYWORD_TABLE.min_length || len > KEYWORD_TABLE.max_length)
+		return TOKEN_ID;
+	unsigned int slot = KEYWORD_TABLE.slots[KeywordHash(s, len, KEYWORD_TABLE.seed)];
+	if (slot == 0)
+		return TOKEN_ID;
+	const Keyword& k = KEYWORDS[slot - 1];
+	if (k.length != len || memcmp(k.text, s, len) != 0)
+		return TOKEN_ID;
+	return k.type;
+}
+
+// Keyword or operator text, or the kind of token for the others.
+const char* TokenName(TokenType type);
+
+typedef unsigned int TokenIterator;
+
+union TokenLiteral
+{
+	long long i;
+	double f;
+};
+
+class TokenBuffer
+{
+private:
+	const char* source;
+	unsigned int base;
+	TokenIterator count;
+	TokenIterator mask;
+	vector<TokenType> types;
+	vector<unsigned int> offsets;
+	vector<unsigned int> lengths;
+	vector<unsigned int> values;
+	vector<TokenLiteral> literals;
+	unsigned int literal_count;
+	mutable LineIndex lines;
+
+	friend class TokenCache;
+
+public:
+	TokenBuffer() : source(NULL), base(0), count(0), mask(~0u), literal_count(0) {};
+
+	void SetSource(const char* src, unsigned int b) { source = src; base = b; };
+	void Reserve(size_t n);
+	void SetRing(TokenIterator capacity);
+	void Resize(TokenIterator n);
+	void Copy(TokenIterator at, const TokenBuffer& other, TokenIterator n);
+	void Replace(TokenIterator first, TokenIterator removed, const TokenBuffer& other,
+		TokenIterator inserted, int offset_delta);
+	TokenIterator Find(unsigned int offset) const;
+	void Add(TokenType type, unsigned int offset, unsigned int length, unsigned int value)
+	{
+		TokenIterator slot = count++ & mask;
+		if (slot == types.size())
+		{
+			types.push_back(type);
+			offsets.push_back(offset);
+			lengths.push_back(length);
+			values.push_back(value);
+		}
+		else
+		{
+			types[slot] = type;
+			offsets[slot] = offset;
+			lengths[slot] = length;
+			values[slot] = value;
+		}
+	};
+
+	TokenIterator GetSize() const { return count; };
+	TokenIterator GetFirst() const
+	{
+		return (count > mask ? count - mask - 1 : 0);
+	};
+	TokenType GetType(TokenIterator i) const { return types[i & mask]; };
+	unsigned int GetOffset(TokenIterator i) const { return offsets[i & mask]; };
+	unsigned int GetLength(TokenIterator i) const { return lengths[i & mask]; };
+	int GetLine(TokenIterator i) const { return GetLineAt(offsets[i & mask]); };
+	unsigned int GetColumn(TokenIterator i) const { return GetColumnAt(offsets[i & mask]); };
+	int GetLineAt(unsigned int offset) const
+	{
+		lines.Extend(source, base, offset);
+		return lines.GetLine(offset);
+	};
+	unsigned int GetColumnAt(unsigned int offset) const
+	{
+		lines.Extend(source, base, offset);
+		return lines.GetColumn(offset);
+	};
+	void IndexLines(unsigned int offset) { lines.Extend(source, base, offset); };
+	void TruncateLines(unsigned int offset) { lines.Truncate(offset); };
+	void DropLines(unsigned int offset) { lines.Drop(offset); };
+	unsigned int GetValue(TokenIterator i) const { return values[i & mask]; };
+	void SetValue(TokenIterator i, unsigned int v) { values[i & mask] = v; };
+
+	unsigned int AddLiteral(TokenLiteral v)
+	{
+		unsigned int slot = literal_count & mask;
+		if (slot == literals.size())
+			literals.push_back(v);
+		else
+			literals[slot] = v;
+		return literal_count++;
+	};
+	void ResizeLiterals(unsigned int n);
+	unsigned int GetLiteralCount() const { return literal_count; };
+	TokenLiteral GetLiteral(unsigned int n) const { return literals[n & mask]; };
+	void SetLiteral(unsigned int n, TokenLiteral v) { literals[n & mask] = v; };
+	string_view GetText(TokenIterator i) const
+	{
+		return string_view(source + (offsets[i & mask] - base), lengths[i & mask]);
+	};
+};
+
 class Token
 {
 private:
-	int line_num;
-	string content;
-	TokenType type;
+	const TokenBuffer* buffer;
+	TokenIterator index;
 
 public:
-	Token(const char* ctt, TokenType t, int ln) : content(ctt), type(t), line_num(ln) {};
-	Token(const string& ctt, TokenType t, int ln) : content(ctt), type(t), line_num(ln) {};
+	Token(const TokenBuffer* b, TokenIterator i) : buffer(b), index(i) {};
 
-	string& GetContent() { return content; };
-	TokenType GetType() { return type; };
-	int GetLine() { return line_num; };
+	string GetContent() const { return string(buffer->GetText(index)); };
+	string_view GetText() const { return buffer->GetText(index); };
+	TokenType GetType() const { return buffer->GetType(index); };
+	unsigned int GetOffset() const { return buffer->GetOffset(index); };
+	int GetLine() const { return buffer->GetLine(index); };
+	unsigned int GetColumn() const { return buffer->GetColumn(index); };
+	unsigned int GetSymbol() const { return buffer->GetValue(index); };
+	long long GetInt() const { return buffer->GetLiteral(buffer->GetValue(index)).i; };
+	double GetFloat() const { return buffer->GetLiteral(buffer->GetValue(index)).f; };
 };
 
-typedef list<Token*> TokenList;
-typedef list<Token*>::iterator TokenIterator;
+// Tokens [first, first + removed) were replaced by inserted new ones.
+// They came from the source lines [begin, end) before the edit, and
+// everything after those lines moved by delta bytes.
+struct TokenEdit
+{
+	TokenIterator first;
+	TokenIterator removed;
+	TokenIterator inserted;
+	unsigned int begin;
+	unsigned int end;
+	int delta;
+};
 
 class Lexer
 {
 private:
-	istream& in;
-	TokenList token_list;
+	MappedFile* file;
+	const ScanKernels* scan;
+	istream* stream;
+	ThreadPool* pool;
+	SymbolTable* symbols;
+	ostream* err;
+	string buffer;
+	unsigned int base;
+	const char* src;
+	const char* cur;
+	const char* end;
+	const char* limit;
+	TokenBuffer tokens;
+	const TokenBuffer* view;
+	TokenIterator start;
+	TokenIterator stop;
 	bool fail;
+	vector<unsigned int> errors;
+	vector<unsigned int> free_literals;
 	TokenIterator it;
-	int line;
 
 private:
-	bool MatchNumber();
-	bool MatchString();
-	bool MatchIdFirst();
-	bool MatchId();
-	bool MatchSymbol();
-	bool MatchOperation();
-	bool MatchLogicalOperation();
-	bool MatchEOL();
-	bool MatchComment();
-	bool MatchBlank();
+	int PeekChar() { return (cur < end ? (unsigned char)*cur : EOF); };
+	Lexer();
+
+	void Tokenize(const char* begin, const char* finish);
+	void TokenizeRange(const char* begin, const char* finish);
+	void TokenizeParallel(const char* begin, const char* finish);
+	void Step();
+	void Refill();
+	void Pull();
+	void AddToken(const char* start, TokenType type, unsigned int value = 0);
 
 	void Consume();
 	void ConsumeComment();
@@ -75,50 +321,55 @@ private:
 	void AddString();
 	void AddId();
 
-	void AddLBrackets();
-	void AddRBrackets();
-	void AddLMBrackets();
-	void AddRMBrackets();
-	void AddLBBrackets();
-	void AddRBBrackets();
-	void AddComma();
-	void AddColon();
-
-	void AddPlus();
-	void AddMinus();
-	void AddMulti();
-	void AddDiv();
-	void AddMod();
-
-	void AddAnd();
-	void AddOr();
-	void AddXor();
-	void AddNot();
-	void AddAssign();
-	void AddInvoke();
-
-	void AddMore();
-	void AddLess();
-
+	void AddOperator(unsigned char cls);
 	void AddEOL();
 
+	void Report(const char* p, const char* msg);
 	void ProcessUnknownToken();
 
 public:
+	static const unsigned int STREAM_LOOKAHEAD = 4096;
+	static const size_t PARALLEL_MIN_SIZE = 1 << 20;
+	static const size_t PARALLEL_MIN_CHUNK = 1 << 18;
+
 	Lexer(istream& is);
+	Lexer(istream& is, unsigned int lookahead);
+	Lexer(const char* path, ThreadPool* tp = NULL, const char* cache = NULL);
+	Lexer(const char* src, size_t size, ThreadPool* tp = NULL);
+	// Tokens [first, last) of a fully lexed source, read in place so that
+	// they can be parsed on another thread. Nothing of whole may change
+	// while this is in use.
+	Lexer(const Lexer& whole, TokenIterator first, TokenIterator last);
 	~Lexer();
 
+	void SetScanKernels(const ScanKernels& kernels) { scan = &kernels; };
+	bool Edit(unsigned int offset, unsigned int length, string_view text,
+		TokenEdit* change = NULL);
+	string_view GetSource() { return string_view(src, end - src); };
+	SymbolTable& GetSymbols() { return *symbols; };
+
 	bool IsFail() { return fail; };
+	// Offsets of the lexical errors, in source order.
+	const vector<unsigned int>& GetErrors() { return errors; };
+	bool IsStreaming() { return stream != NULL; };
+
+	const TokenBuffer& GetTokens() { return *view; };
 
-	TokenIterator StartIterate() { it = token_list.begin(); return it; };
-	TokenIterator RestartIterate() { it = token_list.begin(); return it; };
-	void SetPosition(TokenIterator i) { it = i; };
+	TokenIterator StartIterate() { it = start; return it; };
+	TokenIterator RestartIterate() { it = start; return it; };
+	TokenIterator GetPosition() { return it; };
+	void SetPosition(TokenIterator i);
 	void Next() { ++it; };
 	void Prev() { --it; };
-	TokenIterator Peek() { return it; };
-	TokenIterator Get() { return it++; };
-	bool IsBegin() { return (it == token_list.begin()); };
-	bool IsEnd() { return (it == token_list.end()); };
+	Token Peek() { if (it >= view->GetSize()) Pull(); return Token(view, it); };
+	Token Get() { if (it >= view->GetSize()) Pull(); return Token(view, it++); };
+	bool IsBegin() { return (it == start); };
+	bool IsEnd()
+	{
+		if (it >= view->GetSize())
+			Pull();
+		return (it == view->GetSize() || it == stop);
+	};
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,46 @@
+#include "line_index.h"
+#include "scan.h"
+#include <algorithm>
+
+LineIndex::LineIndex() : scan(&GetScanKernels()), starts(1, 0), scanned(0), dropped(0)
+{}
+
+void LineIndex::Extend(const char* src, unsigned int base, unsigned int offset)
+{
+	if (offset <= scanned)
+		return;
+	const char* p = src + (scanned - base);
+	const char* finish = src + (offset - base);
+	while((p = scan->skip_line(p, finish)) < finish)
+	{
+		++p;
+		starts.push_back(base + (p - src));
+	}
+	scanned = offset;
+}
+
+void LineIndex::Truncate(unsigned int offset)
+{
+	if (offset >= scanned)
+		return;
+	starts.erase(upper_bound(starts.begin(), starts.end(), offset), starts.end());
+	scanned = offset;
+}
+
+// The line holding offset is kept for its columns.
+void LineIndex::Drop(unsigned int offset)
+{
+	vector<unsigned int>::iterator last = upper_bound(starts.begin(), starts.end(), offset) - 1;
+	dropped += last - starts.begin();
+	starts.erase(starts.begin(), last);
+}
+
+int LineIndex::GetLine(unsigned int offset) const
+{
+	return (int)(dropped + (upper_bound(starts.begin(), starts.end(), offset) - starts.begin()));
+}
+
+unsigned int LineIndex::GetColumn(unsigned int offset) const
+{
+	return offset - starts[GetLine(offset) - dropped - 1] + 1;
+}
@@ -0,0 +1,32 @@
+#ifndef _LINE_INDEX_H_
+#define _LINE_INDEX_H_
+
+#include <vector>
+using namespace std;
+
+struct ScanKernels;
+
+// Offsets at which lines start. Nothing is scanned up front: Extend only
+// looks at the text between the last offset asked for and the new one.
+// Drop forgets the lines before an offset, counting them in dropped, so
+// that a streaming lexer holds only the lines of its window.
+class LineIndex
+{
+private:
+	const ScanKernels* scan;
+	vector<unsigned int> starts;
+	unsigned int scanned;
+	unsigned int dropped;
+
+public:
+	LineIndex();
+
+	void Extend(const char* src, unsigned int base, unsigned int offset);
+	void Truncate(unsigned int offset);
+	void Drop(unsigned int offset);
+	unsigned int GetScanned() const { return scanned; };
+	int GetLine(unsigned int offset) const;
+	unsigned int GetColumn(unsigned int offset) const;
+};
+
+#endif
@@ -0,0 +1,492 @@
+#include "ll_parser.h"
+#include "ll_table.h"
+
+TableParser::TableParser(Parser& p)
+	: parser(p), lexer(p.lexer), lookahead(LL_EOF), last(0)
+{}
+
+void TableParser::Shift()
+{
+	if (lookahead == LL_EOF)
+		return;
+	last = lexer.GetPosition();
+	lexer.Next();
+	lookahead = (lexer.IsEnd() ? (unsigned int)LL_EOF : (unsigned int)lexer.Peek().GetType());
+}
+
+void TableParser::Push(ASTNode* node, unsigned int offset)
+{
+	LLValue value = { node, offset, TOKEN_UNKNOWN };
+	values.push_back(value);
+}
+
+LLValue TableParser::Pop()
+{
+	LLValue value = values.back();
+	values.pop_back();
+	return value;
+}
+
+void TableParser::AddStatement(ASTNode* stat, bool else_part)
+{
+	if (!stat)
+		return;
+	ASTNode* block = Top();
+	if (block->GetType() == AST_PROGRAM)
+	{
+		((ProgramNode*)block)->AddStatement(parser.arena, stat);
+		return;
+	}
+	BlockFrame frame = { block, else_part };
+	parser.AddToBlock(frame, stat);
+}
+
+// The operands start where the left one does, as in Parser::expr.
+void TableParser::Binary(ASTType type)
+{
+	LLValue right = Pop();
+	LLValue op = Pop();
+	LLValue& left = values.back();
+	BinaryNode* bn = parser.arena.New<BinaryNode>(type, op.op, left.offset);
+	bn->SetLeft(left.node);
+	bn->SetRight(right.node);
+	left.node = bn;
+}
+
+void TableParser::Parse(ProgramNode* root)
+{
+	symbols.assign(1, LL_START);
+	values.clear();
+	Push(root, 0);
+	lookahead = (lexer.IsEnd() ? (unsigned int)LL_EOF : (unsigned int)lexer.Peek().GetType());
+
+	while(!symbols.empty())
+	{
+		unsigned int symbol = symbols.back();
+		symbols.pop_back();
+
+		if (symbol == TOKEN_EOL)
+		{
+			EndLine();
+			continue;
+		}
+		if (symbol < LL_TERMINALS)
+		{
+			Match(symbol);
+			continue;
+		}
+
+		unsigned int nt = symbol - LL_TERMINALS;
+		if (nt >= LL_NONTERMINALS)
+		{
+			Act(nt - LL_NONTERMINALS);
+			continue;
+		}
+
+		// In panic only the top level still reads statements, as
+		// Parser::Parse does, though none that begins as an assignment.
+		unsigned int entry = LL_TABLE[nt][lookahead];
+		if (parser.panic && nt != RULE_PROGRAM)
+			Panic(nt);
+		else if (entry == 0 || (parser.panic && !StartsStatement()))
+			Fail(nt);
+		else
+			Expand(entry);
+	}
+}
+
+void TableParser::Expand(unsigned int entry)
+{
+	const unsigned char* first = LL_EXPANSION + LL_EXPANSION_START[entry - 1];
+	const unsigned char* end = LL_EXPANSION + LL_EXPANSION_START[entry];
+	symbols.insert(symbols.end(), first, end);
+}
+
+// Whether Parser::statement takes the lookahead as the start of anything
+// but an assignment, which it does not begin after an error.
+bool TableParser::StartsStatement()
+{
+	switch(lookahead)
+	{
+	case TOKEN_IF:
+	case TOKEN_DEF:
+	case TOKEN_FOR:
+	case TOKEN_WHILE:
+	case TOKEN_RETURN:
+	case TOKEN_BREAK:
+	case TOKEN_CONTINUE:
+	case LL_EOF:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Parser::MustMatch. After an error the token is not taken, but stands
+// for the one expected where a node takes its offset.
+void TableParser::Match(unsigned int symbol)
+{
+	if (parser.panic)
+	{
+		if (lookahead != LL_EOF)
+			last = lexer.GetPosition();
+		return;
+	}
+	if (symbol == lookahead)
+		Shift();
+	else
+		parser.Error(TokenName((TokenType)symbol));
+}
+
+// Parser::EndLine. After an error the rest of the line is skipped, and
+// an end reached on the way is left for the block it closes.
+void TableParser::EndLine()
+{
+	if (parser.panic)
+	{
+		parser.Synchronize();
+		lookahead = (lexer.IsEnd() ? (unsigned int)LL_EOF : (unsigned int)lexer.Peek().GetType());
+		if (lookahead == TOKEN_END)
+			return;
+	}
+	Match(TOKEN_EOL);
+}
+
+// What Parser reports as missing where nt fails. At the end of input it
+// asks for the end of line it skips before anything that may follow one
+// inside a statement, and for a token anywhere else. At the top level a
+// stray end is a missing statement.
+string TableParser::Expect(unsigned int nt)
+{
+	if (lookahead == LL_EOF)
+		return (LL_TABLE[nt][TOKEN_EOL] != 0 && !LL_SYNC[nt]) ? TokenName(TOKEN_EOL) : "token";
+	if (nt + LL_TERMINALS == LL_START && lookahead == TOKEN_END)
+		return "statement";
+	return LL_EXPECT[nt];
+}
+
+// Reports the error where the lookahead has no alternative of nt. A
+// statement list then takes the line as a statement that failed at its
+// first token, skips it and goes on, as Parser does; at the end of input
+// the list ends, and a stray end at the top level is skipped along with
+// its line. Any other rule goes on in panic. Parser goes into the
+// elements of brackets that are not closed at once, so those fail in
+// there instead.
+void TableParser::Fail(unsigned int nt)
+{
+	bool elements = (nt == RULE_PARAMS || nt == RULE_ARGS || nt == RULE_ITEMS || nt == RULE_PAIRS);
+	if (elements && lookahead != LL_EOF)
+	{
+		Expand(LL_TABLE[nt][TOKEN_ID]);
+		return;
+	}
+	parser.Error(Expect(nt));
+	if (!LL_SYNC[nt])
+	{
+		Panic(nt);
+		return;
+	}
+	if (lookahead == LL_EOF)
+		return;
+	if (nt == RULE_PROGRAM && lookahead == TOKEN_END)
+		Shift();
+	EndLine();
+	symbols.push_back(nt + LL_TERMINALS);
+}
+
+// After an error Parser goes on without taking tokens up to the end of
+// the line: its loops stop, and its functions return what they have
+// built, or NULL for an expression not begun. Rules do the same here,
+// and those that would leave an expression leave a null node. An if
+// still takes an elif or else that follows, and closes its line.
+void TableParser::Panic(unsigned int nt)
+{
+	switch(nt)
+	{
+	case RULE_ASSIGN:
+	case RULE_EXPR:
+	case RULE_LOGIC:
+	case RULE_COMPARE:
+	case RULE_SUM:
+	case RULE_PRODUCT:
+	case RULE_UNARY:
+	case RULE_PRIMARY:
+	case RULE_ELEMENTS:
+	case RULE_ARGUMENTS:
+	case RULE_MAPPING:
+		Push(NULL, 0);
+		break;
+	case RULE_IFTAIL:
+		if (lookahead == TOKEN_ELIF || lookahead == TOKEN_ELSE)
+		{
+			Expand(LL_TABLE[nt][lookahead]);
+			symbols.pop_back();
+			Shift();
+		}
+		else
+		{
+			Expand(LL_TABLE[nt][TOKEN_END]);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+// Actions build nodes as Parser does: from the token just matched, and
+// with the offsets it would give them.
+void TableParser::Act(unsigned int action)
+{
+	Arena& arena = parser.arena;
+	switch(action)
+	{
+	case ACTION_STAT:
+	{
+		ASTNode* stat = Pop().node;
+		AddStatement(stat, false);
+		break;
+	}
+	case ACTION_ELSE_STAT:
+	{
+		ASTNode* stat = Pop().node;
+		AddStatement(stat, true);
+		break;
+	}
+	case ACTION_IF:
+		Push(arena.New<IfNode>(Last().GetOffset()), Last().GetOffset());
+		break;
+	case ACTION_COND:
+	{
+		ASTNode* cond = Pop().node;
+		if (Top()->GetType() == AST_IF)
+			((IfNode*)Top())->SetCondition(cond);
+		else
+			((WhileNode*)Top())->SetCondition(cond);
+		break;
+	}
+	case ACTION_ELIF:
+	{
+		ASTNode* elif = Pop().node;
+		((IfNode*)Top())->AddElseStatement(arena, elif);
+		break;
+	}
+	case ACTION_FUNCTION:
+		Push(arena.New<FunctionNode>(Last().GetOffset()), Last().GetOffset());
+		break;
+	case ACTION_NAME:
+	{
+		Token token = Last();
+		IdNode* id = arena.New<IdNode>(token.GetOffset(), token.GetSymbol());
+		if (Top()->GetType() == AST_FUNCTION)
+			((FunctionNode*)Top())->SetFunction(id);
+		else
+			((ForNode*)Top())->SetIterator(id);
+		break;
+	}
+	case ACTION_FOR:
+		Push(arena.New<ForNode>(Last().GetOffset()), Last().GetOffset());
+		break;
+	case ACTION_ITER_LIST:
+	{
+		ASTNode* list = Pop().node;
+		((ForNode*)Top())->SetIterList(list);
+		break;
+	}
+	case ACTION_WHILE:
+		Push(arena.New<WhileNode>(Last().GetOffset()), Last().GetOffset());
+		break;
+	case ACTION_RETURN:
+		Push(arena.New<ReturnNode>(Last().GetOffset()), Last().GetOffset());
+		break;
+	case ACTION_SET_RETURN:
+	{
+		ASTNode* value = Pop().node;
+		((ReturnNode*)Top())->SetReturn(value);
+		break;
+	}
+	case ACTION_BREAK:
+		Push(arena.New<BreakNode>(Last().GetOffset()), Last().GetOffset());
+		break;
+	case ACTION_CONTINUE:
+		Push(arena.New<ContinueNode>(Last().GetOffset()), Last().GetOffset());
+		break;
+	case ACTION_TARGET:
+		// Parser takes the operator after the error, for the node.
+		if (!Parser::IsAssignable(Top()))
+		{
+			parser.Error("assignable target");
+			symbols.pop_back();
+			Shift();
+		}
+		break;
+	case ACTION_OP:
+	{
+		Token token = Last();
+		LLValue value = { NULL, token.GetOffset(), token.GetType() };
+		values.push_back(value);
+		break;
+	}
+	case ACTION_ASSIGN:
+		Binary(AST_ASSIGN);
+		break;
+	case ACTION_BOOL:
+		Binary(AST_BOOL);
+		break;
+	case ACTION_LOGIC:
+		Binary(AST_LOGIC);
+		break;
+	case ACTION_COMPARE:
+		Binary(AST_CMP);
+		break;
+	case ACTION_SUM:
+		Binary(AST_ADD);
+		break;
+	case ACTION_PRODUCT:
+		Binary(AST_MULTI);
+		break;
+	case ACTION_PREFIX:
+	{
+		ASTNode* param = Pop().node;
+		LLValue& op = values.back();
+		PreUnaryNode* pn = arena.New<PreUnaryNode>(op.op, op.offset);
+		pn->SetParam(param);
+		op.node = pn;
+		break;
+	}
+	case ACTION_POSTFIX:
+	{
+		LLValue& value = values.back();
+		PostUnaryNode* pn = arena.New<PostUnaryNode>(Last().GetType(), value.offset);
+		pn->SetParam(value.node);
+		value.node = pn;
+		break;
+	}
+	case ACTION_INVOKE:
+	{
+		LLValue& value = values.back();
+		InvokeNode* in = arena.New<InvokeNode>(Last().GetOffset());
+		in->SetInstance(value.node);
+		value.node = in;
+		break;
+	}
+	case ACTION_ATTR:
+	{
+		Token token = Last();
+		((InvokeNode*)Top())->SetAttr(arena.New<IdNode>(token.GetOffset(), token.GetSymbol()));
+		break;
+	}
+	case ACTION_CALL:
+	{
+		LLValue& value = values.back();
+		CallNode* cn = arena.New<CallNode>(Last().GetOffset());
+		cn->SetFunction(value.node);
+		value.node = cn;
+		break;
+	}
+	case ACTION_INDEX:
+	{
+		LLValue& value = values.back();
+		IndexNode* in = arena.New<IndexNode>(Last().GetOffset());
+		in->SetSource(value.node);
+		value.node = in;
+		break;
+	}
+	case ACTION_SET_INDEX:
+	{
+		ASTNode* index = Pop().node;
+		((IndexNode*)Top())->SetIndex(index);
+		break;
+	}
+	case ACTION_SET_ELEMENTS:
+	{
+		ElementsNode* elm = (ElementsNode*)Pop().node;
+		switch(Top()->GetType())
+		{
+		case AST_CALL:
+			((CallNode*)Top())->SetParams(elm);
+			break;
+		case AST_FUNCTION:
+			((FunctionNode*)Top())->SetParam(elm);
+			break;
+		default:
+			((ListNode*)Top())->SetElements(elm);
+			break;
+		}
+		break;
+	}
+	case ACTION_PAREN:
+	{
+		// The inner node stands for the brackets, starting at the '('.
+		ASTNode* inner = Pop().node;
+		values.back().node = inner;
+		break;
+	}
+	case ACTION_ID:
+	{
+		Token token = Last();
+		Push(arena.New<IdNode>(token.GetOffset(), token.GetSymbol()), token.GetOffset());
+		break;
+	}
+	case ACTION_STRING:
+	{
+		Token token = Last();
+		string_view text = token.GetText();
+		Push(arena.New<StringNode>(token.GetOffset(),
+			string_view(arena.Copy(text.data(), text.size()), text.size())), token.GetOffset());
+		break;
+	}
+	case ACTION_INT:
+	{
+		Token token = Last();
+		Push(arena.New<IntNode>(token.GetOffset(), token.GetInt()), token.GetOffset());
+		break;
+	}
+	case ACTION_FLOAT:
+	{
+		Token token = Last();
+		Push(arena.New<FloatNode>(token.GetOffset(), token.GetFloat()), token.GetOffset());
+		break;
+	}
+	case ACTION_LIST:
+		Push(arena.New<ListNode>(Last().GetOffset()), Last().GetOffset());
+		break;
+	case ACTION_DICT:
+		Push(arena.New<DictNode>(Last().GetOffset()), Last().GetOffset());
+		break;
+	case ACTION_SET_MAPPING:
+	{
+		MappingNode* mn = (MappingNode*)Pop().node;
+		((DictNode*)Top())->SetMapping(mn);
+		break;
+	}
+	case ACTION_ELEMENTS:
+	{
+		// Elements start at their first token, still to be matched.
+		unsigned int offset = lexer.Peek().GetOffset();
+		Push(arena.New<ElementsNode>(offset), offset);
+		break;
+	}
+	case ACTION_ELEMENT:
+	{
+		// An element or pair that failed is left out, as in Parser.
+		ASTNode* elm = Pop().node;
+		if (!parser.panic)
+			((ElementsNode*)Top())->AddElement(arena, elm);
+		break;
+	}
+	case ACTION_MAPPING:
+	{
+		unsigned int offset = lexer.Peek().GetOffset();
+		Push(arena.New<MappingNode>(offset), offset);
+		break;
+	}
+	case ACTION_PAIR:
+	{
+		ASTNode* value = Pop().node;
+		ASTNode* key = Pop().node;
+		if (!parser.panic)
+			((MappingNode*)Top())->AddMapping(arena, key, value);
+		break;
+	}
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef _LL_PARSER_H_
+#define _LL_PARSER_H_
+
+#include "lexer.h"
+#include "parser.h"
+#include <string>
+#include <vector>
+using namespace std;
+
+// A node being built, with the offset its expression starts at, or the
+// operator token waiting for its right operand.
+struct LLValue
+{
+	ASTNode* node;
+	unsigned int offset;
+	TokenType op;
+};
+
+// Parses with the tables llgen builds from grammar.ll instead of the
+// functions of Parser, into the same nodes and the same arena. Errors go
+// through Parser::Error; with a sink, parsing goes on in Parser's panic
+// mode, so that the same errors are reported and the same partial nodes
+// are kept.
+class TableParser
+{
+private:
+	Parser& parser;
+	Lexer& lexer;
+	vector<unsigned char> symbols;
+	vector<LLValue> values;
+	unsigned int lookahead;
+	TokenIterator last;
+
+	void Shift();
+	void Expand(unsigned int entry);
+	bool StartsStatement();
+	void Match(unsigned int symbol);
+	void EndLine();
+	string Expect(unsigned int nt);
+	void Fail(unsigned int nt);
+	void Panic(unsigned int nt);
+	void Act(unsigned int action);
+	void Push(ASTNode* node, unsigned int offset);
+	LLValue Pop();
+	ASTNode* Top() { return values.back().node; };
+	Token Last() { return Token(&lexer.GetTokens(), last); };
+	void AddStatement(ASTNode* stat, bool else_part);
+	void Binary(ASTType type);
+
+public:
+	TableParser(Parser& p);
+
+	void Parse(ProgramNode* root);
+};
+
+#endif
@@ -0,0 +1,664 @@
+#include "lexer.h"
+#include <bitset>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+
+// llgen grammar.ll out: reads the grammar and writes the LL(1) tables
+// for TableParser to out.h and out.cpp. Only the token names of lexer.h
+// are needed, so it is built without the lexer.
+
+constexpr unsigned int TERMINALS = TOKEN_UNKNOWN + 2;
+constexpr unsigned int END_OF_INPUT = TOKEN_UNKNOWN + 1;
+
+typedef bitset<TERMINALS> TerminalSet;
+
+enum SymbolKind { SYMBOL_TERMINAL, SYMBOL_NONTERMINAL, SYMBOL_ACTION };
+
+struct Symbol
+{
+	SymbolKind kind;
+	unsigned int index;
+};
+
+struct Production
+{
+	unsigned int lhs;
+	unsigned int line;
+	vector<Symbol> rhs;
+};
+
+struct Nonterminal
+{
+	string name;
+	unsigned int line;
+	bool defined;
+	bool sync;
+	bool nullable;
+	string expect;
+	TerminalSet first;
+	TerminalSet follow;
+};
+
+class Generator
+{
+private:
+	string path;
+	string text;
+	size_t pos;
+	unsigned int line;
+	bool verbose;
+
+	map<string, unsigned int> terminals;
+	map<string, unsigned int> nonterminal_ids;
+	map<string, unsigned int> action_ids;
+	vector<Nonterminal> nonterminals;
+	vector<string> actions;
+	vector<Production> productions;
+	vector<unsigned char> table;
+	vector<unsigned short> entries;
+	vector<vector<unsigned char> > expansions;
+
+	void Fail(unsigned int at, const string& message)
+	{
+		cerr << path << ":" << at << ": " << message << endl;
+		exit(1);
+	};
+	string Word();
+	unsigned int NonterminalId(const string& name);
+	Symbol Lookup(const string& word);
+	void Rule(const string& lhs);
+
+	TerminalSet First(const vector<Symbol>& rhs, size_t from, bool& nullable);
+	void ComputeFirst();
+	void ComputeFollow();
+	void FillEmpty();
+	void Set(unsigned int nt, unsigned int t, unsigned int prod, bool follow);
+	unsigned int Encode(const Symbol& sym);
+	vector<unsigned char> Expansion(unsigned int nt, unsigned int t);
+	string TerminalName(unsigned int t);
+
+public:
+	Generator(const string& p, bool v) : path(p), pos(0), line(1), verbose(v) {};
+
+	bool Read();
+	void Build();
+	bool Write(const string& out);
+};
+
+string Generator::TerminalName(unsigned int t)
+{
+	for (map<string, unsigned int>::iterator it = terminals.begin(); it != terminals.end(); ++it)
+	{
+		if (it->second == t)
+			return it->first;
+	}
+	return to_string(t);
+}
+
+bool Generator::Read()
+{
+	ifstream in(path.c_str(), ios::binary);
+	if (!in)
+		return false;
+	ostringstream oss;
+	oss << in.rdbuf();
+	text = oss.str();
+
+#define TERMINAL_ENTRY(s, t) terminals["'" s "'"] = t;
+	KEYWORD_LIST(TERMINAL_ENTRY)
+	OPERATOR_LIST(TERMINAL_ENTRY)
+#undef TERMINAL_ENTRY
+	terminals["INT"] = TOKEN_INT;
+	terminals["FLOAT"] = TOKEN_FLOAT;
+	terminals["STRING"] = TOKEN_STRING;
+	terminals["ID"] = TOKEN_ID;
+	terminals["EOL"] = TOKEN_EOL;
+	terminals["EOF"] = END_OF_INPUT;
+
+	while(true)
+	{
+		string word = Word();
+		if (word.empty())
+			break;
+		if (word == "%sync")
+		{
+			unsigned int at = line;
+			while(true)
+			{
+				size_t save = pos;
+				unsigned int save_line = line;
+				string name = Word();
+				if (name.empty() || line != at || !islower((unsigned char)name[0]))
+				{
+					pos = save;
+					line = save_line;
+					break;
+				}
+				nonterminals[NonterminalId(name)].sync = true;
+			}
+			continue;
+		}
+		if (word == "%expect")
+		{
+			unsigned int at = line;
+			string expect = Word();
+			if (expect.size() < 2 || expect[0] != '"' || line != at)
+				Fail(line, "expected a quoted expectation after %expect");
+			expect = expect.substr(1, expect.size() - 2);
+			while(true)
+			{
+				size_t save = pos;
+				unsigned int save_line = line;
+				string name = Word();
+				if (name.empty() || line != at || !islower((unsigned char)name[0]))
+				{
+					pos = save;
+					line = save_line;
+					break;
+				}
+				nonterminals[NonterminalId(name)].expect = expect;
+			}
+			continue;
+		}
+		if (!islower((unsigned char)word[0]))
+			Fail(line, "expected a rule name, found " + word);
+		if (Word() != ":")
+			Fail(line, "expected ':' after " + word);
+		Rule(word);
+	}
+
+	for (size_t i = 0; i < nonterminals.size(); ++i)
+	{
+		if (!nonterminals[i].defined)
+			Fail(nonterminals[i].line, "no rule for " + nonterminals[i].name);
+	}
+	if (productions.empty())
+		Fail(line, "no rules");
+	return true;
+}
+
+string Generator::Word()
+{
+	while(pos < text.size())
+	{
+		char c = text[pos];
+		if (c == '\n')
+			++line;
+		if (c == '#')
+		{
+			while(pos < text.size() && text[pos] != '\n')
+				++pos;
+			continue;
+		}
+		if (!isspace((unsigned char)c))
+			break;
+		++pos;
+	}
+	if (pos == text.size())
+		return "";
+
+	size_t start = pos;
+	char c = text[pos++];
+	if (c == '\'' || c == '"')
+	{
+		while(pos < text.size() && text[pos] != c && text[pos] != '\n')
+			++pos;
+		if (pos == text.size() || text[pos] != c)
+			Fail(line, c == '"' ? "unterminated expectation" : "unterminated token name");
+		++pos;
+	}
+	else if (c != ':' && c != '|' && c != ';')
+	{
+		while(pos < text.size() && (isalnum((unsigned char)text[pos]) || text[pos] == '_'))
+			++pos;
+	}
+	return text.substr(start, pos - start);
+}
+
+unsigned int Generator::NonterminalId(const string& name)
+{
+	map<string, unsigned int>::iterator it = nonterminal_ids.find(name);
+	if (it != nonterminal_ids.end())
+		return it->second;
+	Nonterminal nt;
+	nt.name = name;
+	nt.line = line;
+	nt.defined = false;
+	nt.sync = false;
+	nt.nullable = false;
+	nonterminals.push_back(nt);
+	nonterminal_ids[name] = nonterminals.size() - 1;
+	return nonterminals.size() - 1;
+}
+
+Symbol Generator::Lookup(const string& word)
+{
+	Symbol sym;
+	if (word[0] == '@' && word.size() > 1)
+	{
+		map<string, unsigned int>::iterator it = action_ids.find(word);
+		if (it == action_ids.end())
+		{
+			actions.push_back(word.substr(1));
+			it = action_ids.insert(make_pair(word, actions.size() - 1)).first;
+		}
+		sym.kind = SYMBOL_ACTION;
+		sym.index = it->second;
+	}
+	else if (islower((unsigned char)word[0]))
+	{
+		sym.kind = SYMBOL_NONTERMINAL;
+		sym.index = NonterminalId(word);
+	}
+	else
+	{
+		map<string, unsigned int>::iterator it = terminals.find(word);
+		if (it == terminals.end())
+			Fail(line, "unknown token " + word);
+		sym.kind = SYMBOL_TERMINAL;
+		sym.index = it->second;
+	}
+	return sym;
+}
+
+void Generator::Rule(const string& lhs)
+{
+	unsigned int nt = NonterminalId(lhs);
+	if (nonterminals[nt].defined)
+		Fail(line, "second rule for " + lhs);
+	nonterminals[nt].defined = true;
+	nonterminals[nt].line = line;
+
+	Production prod;
+	prod.lhs = nt;
+	prod.line = line;
+	while(true)
+	{
+		string word = Word();
+		if (word.empty())
+			Fail(line, "missing ';' after the rule for " + lhs);
+		if (word == "|" || word == ";")
+		{
+			productions.push_back(prod);
+			prod.rhs.clear();
+			prod.line = line;
+			if (word == ";")
+				return;
+			continue;
+		}
+		prod.rhs.push_back(Lookup(word));
+	}
+}
+
+// Terminals that can start rhs[from..]; nullable tells whether all of it
+// can derive nothing. Actions derive nothing.
+TerminalSet Generator::First(const vector<Symbol>& rhs, size_t from, bool& nullable)
+{
+	TerminalSet set;
+	for (size_t i = from; i < rhs.size(); ++i)
+	{
+		const Symbol& sym = rhs[i];
+		if (sym.kind == SYMBOL_ACTION)
+			continue;
+		if (sym.kind == SYMBOL_TERMINAL)
+		{
+			set.set(sym.index);
+			nullable = false;
+			return set;
+		}
+		set |= nonterminals[sym.index].first;
+		if (!nonterminals[sym.index].nullable)
+		{
+			nullable = false;
+			return set;
+		}
+	}
+	nullable = true;
+	return set;
+}
+
+void Generator::ComputeFirst()
+{
+	bool changed = true;
+	while(changed)
+	{
+		changed = false;
+		for (size_t p = 0; p < productions.size(); ++p)
+		{
+			Nonterminal& nt = nonterminals[productions[p].lhs];
+			bool nullable;
+			TerminalSet set = First(productions[p].rhs, 0, nullable);
+			if ((set & ~nt.first).any() || (nullable && !nt.nullable))
+			{
+				nt.first |= set;
+				nt.nullable = nt.nullable || nullable;
+				changed = true;
+			}
+		}
+	}
+}
+
+void Generator::ComputeFollow()
+{
+	nonterminals[productions[0].lhs].follow.set(END_OF_INPUT);
+	bool changed = true;
+	while(changed)
+	{
+		changed = false;
+		for (size_t p = 0; p < productions.size(); ++p)
+		{
+			const vector<Symbol>& rhs = productions[p].rhs;
+			for (size_t i = 0; i < rhs.size(); ++i)
+			{
+				if (rhs[i].kind != SYMBOL_NONTERMINAL)
+					continue;
+				Nonterminal& nt = nonterminals[rhs[i].index];
+				bool nullable;
+				TerminalSet set = First(rhs, i + 1, nullable);
+				if (nullable)
+					set |= nonterminals[productions[p].lhs].follow;
+				if ((set & ~nt.follow).any())
+				{
+					nt.follow |= set;
+					changed = true;
+				}
+			}
+		}
+	}
+}
+
+// Entries from FIRST sets are placed before those from FOLLOW sets, and
+// a FOLLOW entry never replaces one: a token that can continue a rule
+// continues it. Two alternatives starting with the same token are an
+// error.
+void Generator::Set(unsigned int nt, unsigned int t, unsigned int prod, bool follow)
+{
+	unsigned char& entry = table[nt * TERMINALS + t];
+	if (entry == 0)
+	{
+		entry = prod + 1;
+		return;
+	}
+	if (entry == prod + 1)
+		return;
+	if (!follow)
+	{
+		ostringstream oss;
+		oss << "alternatives of " << nonterminals[nt].name << " on lines "
+			<< productions[entry - 1].line << " and " << productions[prod].line
+			<< " both start with " << TerminalName(t);
+		Fail(productions[prod].line, oss.str());
+	}
+	bool nullable;
+	First(productions[entry - 1].rhs, 0, nullable);
+	if (nullable)
+	{
+		ostringstream oss;
+		oss << "alternatives of " << nonterminals[nt].name << " on lines "
+			<< productions[entry - 1].line << " and " << productions[prod].line
+			<< " can both be empty before " << TerminalName(t);
+		Fail(productions[prod].line, oss.str());
+	}
+	if (verbose)
+	{
+		cerr << path << ":" << productions[entry - 1].line << ": note: "
+			<< nonterminals[nt].name << " takes " << TerminalName(t)
+			<< " that could also follow it" << endl;
+	}
+}
+
+// A rule that can be empty and has no %expect takes its empty
+// alternative where the lookahead is an error, so that the error is
+// found by what follows, as Parser finds it once a loop ends. Any other
+// rule that can fail needs an %expect.
+void Generator::FillEmpty()
+{
+	for (unsigned int nt = 0; nt < nonterminals.size(); ++nt)
+	{
+		const Nonterminal& n = nonterminals[nt];
+		unsigned int empty = productions.size();
+		for (size_t p = 0; p < productions.size() && n.nullable; ++p)
+		{
+			bool nullable;
+			First(productions[p].rhs, 0, nullable);
+			if (productions[p].lhs == nt && nullable)
+				empty = p;
+		}
+		bool fails = false;
+		for (unsigned int t = 0; t < TERMINALS; ++t)
+		{
+			unsigned char& entry = table[nt * TERMINALS + t];
+			if (entry != 0)
+				continue;
+			if (empty < productions.size() && n.expect.empty())
+				entry = empty + 1;
+			else
+				fails = true;
+		}
+		if (fails && n.expect.empty())
+			Fail(n.line, "no %expect for " + n.name);
+	}
+}
+
+void Generator::Build()
+{
+	unsigned int symbols = TERMINALS + nonterminals.size() + actions.size();
+	if (productions.size() >= 255 || symbols > 256)
+		Fail(line, "grammar too large for the table types");
+
+	ComputeFirst();
+	ComputeFollow();
+
+	table.assign(nonterminals.size() * TERMINALS, 0);
+	for (size_t p = 0; p < productions.size(); ++p)
+	{
+		bool nullable;
+		TerminalSet set = First(productions[p].rhs, 0, nullable);
+		for (unsigned int t = 0; t < TERMINALS; ++t)
+		{
+			if (set.test(t))
+				Set(productions[p].lhs, t, p, false);
+		}
+	}
+	for (size_t p = 0; p < productions.size(); ++p)
+	{
+		bool nullable;
+		First(productions[p].rhs, 0, nullable);
+		if (!nullable)
+			continue;
+		const TerminalSet& follow = nonterminals[productions[p].lhs].follow;
+		for (unsigned int t = 0; t < TERMINALS; ++t)
+		{
+			if (follow.test(t))
+				Set(productions[p].lhs, t, p, true);
+		}
+	}
+	FillEmpty();
+
+	map<vector<unsigned char>, unsigned int> seen;
+	entries.assign(table.size(), 0);
+	for (unsigned int nt = 0; nt < nonterminals.size(); ++nt)
+	{
+		for (unsigned int t = 0; t < TERMINALS; ++t)
+		{
+			if (table[nt * TERMINALS + t] == 0)
+				continue;
+			vector<unsigned char> exp = Expansion(nt, t);
+			map<vector<unsigned char>, unsigned int>::iterator it = seen.find(exp);
+			if (it == seen.end())
+			{
+				expansions.push_back(exp);
+				it = seen.insert(make_pair(exp, expansions.size() - 1)).first;
+			}
+			entries[nt * TERMINALS + t] = it->second + 1;
+		}
+	}
+	if (expansions.size() >= 65535)
+		Fail(line, "grammar too large for the table types");
+}
+
+unsigned int Generator::Encode(const Symbol& sym)
+{
+	if (sym.kind == SYMBOL_NONTERMINAL)
+		return TERMINALS + sym.index;
+	if (sym.kind == SYMBOL_ACTION)
+		return TERMINALS + nonterminals.size() + sym.index;
+	return sym.index;
+}
+
+// What nt expands to on lookahead t, back to front. Nonterminals at the
+// front are expanded in turn for the same lookahead, so that the parser
+// looks up a chain such as expr down to primary once; it stops at an
+// action, a terminal, a statement list, which recovers on its own, or a
+// nonterminal that is an error on t.
+vector<unsigned char> Generator::Expansion(unsigned int nt, unsigned int t)
+{
+	vector<unsigned char> exp;
+	unsigned int prod = table[nt * TERMINALS + t] - 1;
+	while(true)
+	{
+		const vector<Symbol>& rhs = productions[prod].rhs;
+		for (size_t i = rhs.size(); i-- > 0; )
+			exp.push_back(Encode(rhs[i]));
+		if (exp.empty())
+			return exp;
+		unsigned int top = exp.back();
+		if (top < TERMINALS || top >= TERMINALS + nonterminals.size())
+			return exp;
+		const Nonterminal& next = nonterminals[top - TERMINALS];
+		unsigned char entry = table[(top - TERMINALS) * TERMINALS + t];
+		if (next.sync || entry == 0)
+			return exp;
+		exp.pop_back();
+		prod = entry - 1;
+	}
+}
+
+static string Upper(const string& s)
+{
+	string r = s;
+	for (size_t i = 0; i < r.size(); ++i)
+		r[i] = toupper((unsigned char)r[i]);
+	return r;
+}
+
+bool Generator::Write(const string& out)
+{
+	string base = out;
+	size_t slash = base.find_last_of("/\\");
+	if (slash != string::npos)
+		base = base.substr(slash + 1);
+
+	ofstream header((out + ".h").c_str());
+	if (!header)
+		return false;
+	header << "// Generated by llgen from " << path << "; do not edit.\n"
+		<< "#ifndef _" << Upper(base) << "_H_\n"
+		<< "#define _" << Upper(base) << "_H_\n\n"
+		<< "#include \"lexer.h\"\n\n"
+		<< "enum LLAction : unsigned char {\n";
+	for (size_t i = 0; i < actions.size(); ++i)
+	{
+		header << "\tACTION_" << Upper(actions[i]) << (i == 0 ? " = 0" : "")
+			<< (i + 1 < actions.size() ? "," : "") << "\n";
+	}
+	header << "};\n\n"
+		<< "enum LLRule : unsigned char {\n";
+	for (size_t i = 0; i < nonterminals.size(); ++i)
+	{
+		header << "\tRULE_" << Upper(nonterminals[i].name) << (i == 0 ? " = 0" : "")
+			<< (i + 1 < nonterminals.size() ? "," : "") << "\n";
+	}
+	header << "};\n\n"
+		<< "constexpr unsigned int LL_TERMINALS = " << TERMINALS << ";\n"
+		<< "constexpr unsigned int LL_NONTERMINALS = " << nonterminals.size() << ";\n"
+		<< "constexpr unsigned int LL_ACTIONS = " << actions.size() << ";\n"
+		<< "constexpr unsigned int LL_EXPANSIONS = " << expansions.size() << ";\n"
+		<< "constexpr unsigned int LL_EOF = " << END_OF_INPUT << ";\n"
+		<< "constexpr unsigned int LL_START = " << TERMINALS + productions[0].lhs << ";\n\n"
+		<< "// Symbols are terminals (token types and LL_EOF), then nonterminals,\n"
+		<< "// then actions. A table entry is the expansion to push plus one, or\n"
+		<< "// zero where the lookahead is an error. Expansion e is stored back to\n"
+		<< "// front at [LL_EXPANSION_START[e], LL_EXPANSION_START[e + 1]).\n"
+		<< "extern const unsigned short LL_TABLE[LL_NONTERMINALS][LL_TERMINALS];\n"
+		<< "extern const unsigned short LL_EXPANSION_START[LL_EXPANSIONS + 1];\n"
+		<< "extern const unsigned char LL_EXPANSION[];\n"
+		<< "// LL_EXPECT is what an error at a nonterminal is reported as missing.\n"
+		<< "extern const char* const LL_EXPECT[LL_NONTERMINALS];\n"
+		<< "extern const bool LL_SYNC[LL_NONTERMINALS];\n\n"
+		<< "#endif\n";
+	if (!header)
+		return false;
+
+	ofstream source((out + ".cpp").c_str());
+	if (!source)
+		return false;
+	source << "// Generated by llgen from " << path << "; do not edit.\n"
+		<< "#include \"" << base << ".h\"\n\n"
+		<< "const unsigned short LL_TABLE[LL_NONTERMINALS][LL_TERMINALS] = {\n";
+	for (size_t nt = 0; nt < nonterminals.size(); ++nt)
+	{
+		source << "\t{";
+		for (unsigned int t = 0; t < TERMINALS; ++t)
+			source << (t ? "," : "") << entries[nt * TERMINALS + t];
+		source << "}, // " << nonterminals[nt].name << "\n";
+	}
+	source << "};\n\n"
+		<< "const unsigned short LL_EXPANSION_START[LL_EXPANSIONS + 1] = {";
+	unsigned int total = 0;
+	for (size_t e = 0; e < expansions.size(); ++e)
+	{
+		source << (e % 16 ? " " : "\n\t") << total << ",";
+		total += expansions[e].size();
+	}
+	source << "\n\t" << total << "\n};\n\n"
+		<< "const unsigned char LL_EXPANSION[] = {\n";
+	for (size_t e = 0; e < expansions.size(); ++e)
+	{
+		source << "\t";
+		for (size_t i = 0; i < expansions[e].size(); ++i)
+			source << (unsigned int)expansions[e][i] << ",";
+		source << "\n";
+	}
+	source << "\t0\n};\n\n"
+		<< "const char* const LL_EXPECT[LL_NONTERMINALS] = {\n";
+	for (size_t nt = 0; nt < nonterminals.size(); ++nt)
+		source << "\t\"" << nonterminals[nt].expect << "\", // " << nonterminals[nt].name << "\n";
+	source << "};\n\n"
+		<< "const bool LL_SYNC[LL_NONTERMINALS] = {";
+	for (size_t nt = 0; nt < nonterminals.size(); ++nt)
+		source << (nt % 8 ? " " : "\n\t") << (nonterminals[nt].sync ? "true" : "false") << ",";
+	source << "\n};\n";
+	return (bool)source;
+}
+
+int main(int argc, char** argv)
+{
+	bool verbose = false;
+	int first = 1;
+	if (argc > 1 && strcmp(argv[1], "-v") == 0)
+	{
+		verbose = true;
+		++first;
+	}
+	if (argc - first != 2)
+	{
+		cerr << "usage: llgen [-v] grammar out" << endl;
+		return 1;
+	}
+
+	Generator gen(argv[first], verbose);
+	if (!gen.Read())
+	{
+		cerr << "llgen: can not open " << argv[first] << endl;
+		return 1;
+	}
+	gen.Build();
+	if (!gen.Write(argv[first + 1]))
+	{
+		cerr << "llgen: can not write " << argv[first + 1] << ".h/.cpp" << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -1,11 +1,79 @@
 #include "lexer.h"
 #include "parser.h"
+#include "flat_ast.h"
+#include "ast_cache.h"
+#include "mapped_file.h"
+#include "stats.h"
+#include "symbol_table.h"
+#include <cstring>
 
-int main()
+static void PrintStats(const Stats& stats, bool json)
 {
-	ifstream ifs("code");
-	Lexer *lexer = new Lexer(ifs);
-	ifs.close();
+	if (json)
+		stats.PrintJSON(cerr);
+	else
+		stats.Print(cerr);
+}
+
+// compiler.exe [--stats | --stats=json] [--table] [--cache] [source]
+int main(int argc, char** argv)
+{
+	const char* path = "code";
+	bool show_stats = false, json = false, table = false, use_cache = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--stats") == 0)
+			show_stats = true;
+		else if (strcmp(argv[i], "--stats=json") == 0)
+			show_stats = json = true;
+		else if (strcmp(argv[i], "--table") == 0)
+			table = true;
+		else if (strcmp(argv[i], "--cache") == 0)
+			use_cache = true;
+		else
+			path = argv[i];
+	}
+	// The saved tree stands in for the default parser, so the table
+	// parser always runs.
+	use_cache = use_cache && !table;
+	string cache_path = string(path) + ".ast";
+	Stats stats;
+
+	stats.Begin("read");
+	MappedFile source(path);
+	stats.End();
+	if (source.IsFail())
+	{
+		cerr << "[Error] Can not open file: " << path << endl;
+		return -1;
+	}
+
+	// Unchanged source is served from its saved tree without lexing or
+	// parsing it again; no tokens exist to be counted then.
+	FlatAST ast;
+	ASTCache cache(cache_path.c_str(), source.GetData(), source.GetSize());
+	if (use_cache)
+	{
+		stats.Begin("load");
+		bool hit = cache.Load(ast, SymbolTable::Global());
+		stats.End();
+		if (hit)
+		{
+			stats.Begin("dump");
+			ast.Dump(cout, SymbolTable::Global());
+			stats.End();
+			if (show_stats)
+			{
+				stats.CountNodes(ast);
+				PrintStats(stats, json);
+			}
+			return 0;
+		}
+	}
+
+	stats.Begin("lex");
+	Lexer *lexer = new Lexer(source.GetData(), source.GetSize());
+	stats.End();
 
 	if (lexer->IsFail())
 	{
@@ -14,19 +82,52 @@ int main()
 		return -1;
 	}
 
-	for (TokenIterator it = lexer->Begin();
-		!lexer->End(); it = lexer->Next())
+	for (lexer->StartIterate(); !lexer->IsEnd(); lexer->Next())
 	{
-		cout << "Token: " << (*it)->GetType() << " \""
-			<< (*it)->GetContent() << "\"" << endl;
+		Token t = lexer->Peek();
+		cout << "Token: " << (int)t.GetType() << " \""
+			<< t.GetText() << "\"" << endl;
 	}
 
 	cin.get();
 
 	Parser* parser = new Parser(*lexer);
+	parser->SetTableDriven(table);
+	int ret = 0;
+	try
+	{
+		stats.Begin("parse");
+		parser->Parse();
+		stats.End();
+		stats.Begin("lower");
+		ast.Build(parser->GetRoot(), lexer->GetSource());
+		stats.End();
+		stats.Begin("dump");
+		ast.Dump(cout, lexer->GetSymbols());
+		stats.End();
+		if (use_cache)
+		{
+			stats.Begin("save");
+			cache.Save(ast, lexer->GetSymbols());
+			stats.End();
+		}
+	}
+	catch (const ParseException& e)
+	{
+		stats.End();
+		cerr << e.what();
+		ret = -1;
+	}
+
+	if (show_stats)
+	{
+		stats.CountTokens(lexer->GetTokens());
+		stats.CountNodes(ast);
+		PrintStats(stats, json);
+	}
 
-	delete lexer;
 	delete parser;
+	delete lexer;
 
-	return 0;
-}
\ No newline at end of file
+	return ret;
+}
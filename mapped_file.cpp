@@ -0,0 +1,153 @@
+#include "mapped_file.h"
+#include "hash.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#include <windows.h>
+
+MappedFile::MappedFile(const char* path)
+	: data(""), size(0), fail(false), file(INVALID_HANDLE_VALUE), mapping(NULL)
+{
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		fail = true;
+		return;
+	}
+
+	LARGE_INTEGER sz;
+	if (!GetFileSizeEx(file, &sz))
+	{
+		fail = true;
+		return;
+	}
+	size = (size_t)sz.QuadPart;
+	if (size == 0)
+		return;
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+	{
+		fail = true;
+		size = 0;
+		return;
+	}
+
+	void* p = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (p == NULL)
+	{
+		fail = true;
+		size = 0;
+		return;
+	}
+	data = (const char*)p;
+}
+
+MappedFile::~MappedFile()
+{
+	if (size > 0)
+		UnmapViewOfFile(data);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+}
+
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MappedFile::MappedFile(const char* path)
+	: data(""), size(0), fail(false), fd(-1)
+{
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		fail = true;
+		return;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		fail = true;
+		return;
+	}
+	size = (size_t)st.st_size;
+	if (size == 0)
+		return;
+
+	void* p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED)
+	{
+		fail = true;
+		size = 0;
+		return;
+	}
+	madvise(p, size, MADV_SEQUENTIAL);
+	data = (const char*)p;
+}
+
+MappedFile::~MappedFile()
+{
+	if (size > 0)
+		munmap((void*)data, size);
+	if (fd >= 0)
+		close(fd);
+}
+
+#endif
+
+static const unsigned int CACHE_ORDER = 0x01020304;
+
+void StampCache(CacheStamp& stamp, const char* magic, unsigned int version,
+	unsigned long long source_hash, unsigned long long source_size, const string& payload)
+{
+	memcpy(stamp.magic, magic, sizeof(stamp.magic));
+	stamp.version = version;
+	stamp.order = CACHE_ORDER;
+	stamp.source_hash = source_hash;
+	stamp.source_size = source_size;
+	stamp.payload_hash = HashBytes(payload.data(), payload.size());
+}
+
+bool CheckStamp(const CacheStamp& stamp, const char* magic, unsigned int version,
+	unsigned long long source_hash, unsigned long long source_size,
+	const char* payload, unsigned long long payload_size)
+{
+	return memcmp(stamp.magic, magic, sizeof(stamp.magic)) == 0 && stamp.version == version
+		&& stamp.order == CACHE_ORDER && stamp.source_hash == source_hash
+		&& stamp.source_size == source_size
+		&& HashBytes(payload, payload_size) == stamp.payload_hash;
+}
+
+bool SaveCacheFile(const string& path, const void* header, size_t header_size,
+	const string& payload)
+{
+	string tmp = path + ".tmp";
+	{
+		ofstream ofs(tmp.c_str(), ios::binary | ios::trunc);
+		ofs.write((const char*)header, header_size);
+		ofs.write(payload.data(), payload.size());
+		if (!ofs)
+		{
+			ofs.close();
+			remove(tmp.c_str());
+			return false;
+		}
+	}
+#ifdef _WIN32
+	remove(path.c_str());
+#endif
+	if (rename(tmp.c_str(), path.c_str()) != 0)
+	{
+		remove(tmp.c_str());
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,54 @@
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <cstddef>
+#include <string>
+using namespace std;
+
+class MappedFile
+{
+private:
+	const char* data;
+	size_t size;
+	bool fail;
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#else
+	int fd;
+#endif
+
+public:
+	MappedFile(const char* path);
+	~MappedFile();
+
+	bool IsFail() { return fail; };
+	const char* GetData() { return data; };
+	size_t GetSize() { return size; };
+};
+
+// The fields every cache file starts with: what the file is, the byte
+// order it was written in, the source it was made from, and a hash of
+// the payload that follows the full header.
+struct CacheStamp
+{
+	char magic[8];
+	unsigned int version;
+	unsigned int order;
+	unsigned long long source_hash;
+	unsigned long long source_size;
+	unsigned long long payload_hash;
+};
+
+void StampCache(CacheStamp& stamp, const char* magic, unsigned int version,
+	unsigned long long source_hash, unsigned long long source_size, const string& payload);
+// The payload has to be known to be payload_size bytes long.
+bool CheckStamp(const CacheStamp& stamp, const char* magic, unsigned int version,
+	unsigned long long source_hash, unsigned long long source_size,
+	const char* payload, unsigned long long payload_size);
+// Writes header and payload beside path and renames the result over it,
+// so a reader never maps a half-written file.
+bool SaveCacheFile(const string& path, const void* header, size_t header_size,
+	const string& payload);
+
+#endif
@@ -1,93 +1,680 @@
 #include "lexer.h"
 #include "parser.h"
+#include "ll_parser.h"
+#include "symbol_table.h"
+#include "thread_pool.h"
+#include <sstream>
+
+Parser::Parser(Lexer& lex, vector<Diagnostic>* sink, ThreadPool* tp)
+	: lexer(lex), root(NULL), diagnostics(sink), locate(true), panic(false), lazy(false), complete(false),
+	reparsed(0), explicit_stack(false), table_driven(false), depth(0), nesting_limit(DEFAULT_NESTING_LIMIT), pool(tp)
+{}
 
-ProgramNode::~ProgramNode()
+bool Parser::MatchToken(TokenType type)
 {
-	for (ParamList::iterator it = statements.begin();
-		it != statements.end(); ++it)
+	if (lexer.IsEnd())
 	{
-		delete *it;
+		Error(TokenName(type));
+		return false;
 	}
+	return (lexer.Peek().GetType() == type);
 }
 
-Parser::Parser(Lexer& lex) : lexer(lex), root(NULL)
-{}
+bool Parser::MatchTokenMultiLine(TokenType type)
+{
+	while(MatchToken(TOKEN_EOL))
+		lexer.Next();
+	return MatchToken(type);
+}
 
-Parser::~Parser()
+TokenType Parser::PeekType()
 {
-	if (root)
+	if (lexer.IsEnd())
 	{
-		delete root;
-		root = NULL;
+		Error("token");
+		return TOKEN_UNKNOWN;
 	}
+	return lexer.Peek().GetType();
 }
 
-bool Parser::MatchToken(TokenType type)
+void Parser::MustMatch(TokenType type)
 {
+	if (panic)
+		return;
+	if (!MatchToken(type))
+		Error(TokenName(type));
+	else
+		lexer.Next();
+}
+
+void Parser::Error(const string& expect)
+{
+	if (panic)
+		return;
+
+	ostringstream oss;
+	oss << "Expect " << expect << " but ";
 	if (lexer.IsEnd())
+		oss << "end of input";
+	else
+		oss << TokenName(lexer.Peek().GetType());
+	Report(oss.str());
+}
+
+// Only the first error of a statement is reported; the rest of it is
+// skipped by Synchronize. Without a sink the error is thrown instead.
+void Parser::Report(const string& message)
+{
+	if (panic)
+		return;
+	panic = true;
+
+	// A chunk parsed on the pool only needs to know that it failed, and
+	// finding the line would write to the index the chunks share.
+	Diagnostic diag;
+	diag.line = 0;
+	diag.column = 0;
+	if (locate && lexer.IsEnd())
+	{
+		lexer.Prev();
+		Token token = lexer.Get();
+		diag.line = token.GetLine();
+		diag.column = token.GetColumn();
+	}
+	else if (locate)
 	{
-		ostringstream oss;
-		oss << "[Error] Can not found token: " << type
-			<< endl;
-		throw ParseException(oss.str());
+		Token token = lexer.Peek();
+		diag.line = token.GetLine();
+		diag.column = token.GetColumn();
 	}
-	return (lexer.Peek()->GetType() == type);
+	diag.message = message;
+
+	if (!diagnostics)
+	{
+		ostringstream msg;
+		msg << "[Error] " << diag.message << " at line " << diag.line
+			<< ", column " << diag.column << endl;
+		throw ParseException(msg.str());
+	}
+	diagnostics->push_back(diag);
 }
 
-bool Parser::MatchTokenMultiLine(TokenType type)
+// Enters one more level of blocks or brackets. Past the nesting limit the
+// construct is reported and skipped whole, so one diagnostic covers it
+// however deep it goes.
+bool Parser::Nest(bool block)
 {
-	while(MatchToken(TokenType::TOKEN_EOL))
+	if (depth < nesting_limit)
+	{
+		++depth;
+		return true;
+	}
+
+	ostringstream oss;
+	oss << "Nesting deeper than " << nesting_limit << " levels";
+	Report(oss.str());
+	if (block)
+	{
 		lexer.Next();
-	return (lexer.Peek()->GetType() == type);
+		SkipBlock();
+		if (!lexer.IsEnd())
+			lexer.Next();
+		EndLine();
+	}
+	else
+	{
+		SkipBrackets();
+	}
+	return false;
 }
 
-void Parser::MustMatch(TokenType type)
+// Moves past the bracket here and everything up to the one matching it.
+void Parser::SkipBrackets()
+{
+	int level = 0;
+	while(!lexer.IsEnd())
+	{
+		switch(lexer.Get().GetType())
+		{
+		case TOKEN_LBRACKETS:
+		case TOKEN_LMBRACKETS:
+		case TOKEN_LBBRACKETS:
+			++level;
+			break;
+		case TOKEN_RBRACKETS:
+		case TOKEN_RMBRACKETS:
+		case TOKEN_RBBRACKETS:
+			--level;
+			break;
+		default:
+			break;
+		}
+		if (level <= 0)
+			return;
+	}
+}
+
+void Parser::Synchronize()
 {
-	Token* token = lexer.Get();
-	if (token->GetType() != type)
+	while(!lexer.IsEnd())
 	{
-		int line = token->GetLine();
-		ostringstream oss;
-		oss << "[Error] Expect " << type << " but "
-			<< token->GetType() << " at line " << line
-			<< endl;
-		throw ParseException(oss.str());
+		TokenType type = lexer.Peek().GetType();
+		if (type == TOKEN_EOL || type == TOKEN_END)
+			break;
+		lexer.Next();
 	}
+	// Nothing is left to resume at once the input is exhausted.
+	panic = lexer.IsEnd();
+}
+
+// Closes a line. After an error the line is skipped, and an end reached
+// while skipping is left for the enclosing block.
+void Parser::EndLine()
+{
+	if (panic)
+	{
+		Synchronize();
+		if (!lexer.IsEnd() && lexer.Peek().GetType() == TOKEN_END)
+			return;
+	}
+	MustMatch(TOKEN_EOL);
+}
+
+// Skips blank lines and tells whether another statement follows before
+// the block's end, or its elif/else when else_close is set.
+bool Parser::MoreStatements(bool else_close)
+{
+	while(true)
+	{
+		TokenType type = PeekType();
+		if (panic)
+			return false;
+		if (type == TOKEN_EOL)
+		{
+			lexer.Next();
+			continue;
+		}
+		return type != TOKEN_END
+			&& !(else_close && (type == TOKEN_ELIF || type == TOKEN_ELSE));
+	}
+}
+
+IdNode* Parser::identifier(const char* expect)
+{
+	if (!MatchToken(TOKEN_ID))
+	{
+		Error(expect);
+		return NULL;
+	}
+	Token token = lexer.Get();
+	return arena.New<IdNode>(token.GetOffset(), token.GetSymbol());
 }
 
 void Parser::Parse()
 {
-	root = new ProgramNode();
+	arena.Reset();
+	reparsed = 0;
+	root = arena.New<ProgramNode>();
+	panic = false;
+	complete = false;
+	depth = 0;
+	work.clear();
+	open.clear();
+	size_t reported = (diagnostics ? diagnostics->size() : 0);
+	if (pool && !lazy && !lexer.IsStreaming() && ParseParallel())
+	{
+		complete = true;
+		return;
+	}
+
 	lexer.StartIterate();
-	while(!lexer.End())
+	if (table_driven)
+	{
+		TableParser table(*this);
+		table.Parse(root);
+		complete = (!diagnostics || diagnostics->size() == reported);
+		return;
+	}
+
+	while(!lexer.IsEnd())
 	{
-		if (MatchToken(TokenType::EOL))
+		TokenType type = lexer.Peek().GetType();
+		if (type == TOKEN_EOL)
+		{
+			lexer.Next();
+			continue;
+		}
+		if (type == TOKEN_END)
+		{
+			Error("statement");
+			lexer.Next();
+			EndLine();
 			continue;
+		}
 
 		ASTNode* stat = statement();
-		root->AddStatement(stat);
+		if (stat)
+			root->AddStatement(arena, stat);
 	}
+
+	complete = (!diagnostics || diagnostics->size() == reported);
 }
 
-ASTNode* Parser::statement()
+void Parser::ParseBody(FunctionNode* node)
 {
-	ASTNode* tmp = NULL;
+	TokenIterator at = lexer.GetPosition();
+	bool was_panic = panic;
+	unsigned int was_depth = depth;
+	panic = false;
+	depth = node->depth;
+
+	// Cleared first, so that asking for the statements while they are
+	// being parsed does not start over.
+	TokenIterator body = node->GetBody();
+	node->SetBody(NULL, body, depth);
+	lexer.SetPosition(body);
+	while(MoreStatements(false))
+	{
+		ASTNode* stat = statement();
+		if (stat)
+			node->AddStatement(arena, stat);
+	}
 
-	if (MatchToken(TOKEN_IF))
+	lexer.SetPosition(at);
+	panic = was_panic;
+	depth = was_depth;
+}
+
+static void PushList(vector<ASTNode*>& stack, const NodeLink* l)
+{
+	for (; l; l = l->next)
+		stack.push_back(l->node);
+}
+
+// Moves reused subtrees to where their source is after an edit. Nodes
+// wait on a stack instead of the C++ one, as in the explicit-stack parser,
+// so that deep nesting cannot overflow it.
+static void ShiftList(const NodeLink* l, int delta)
+{
+	vector<ASTNode*> stack;
+	PushList(stack, l);
+	while(!stack.empty())
 	{
-		tmp = ifstat();
+		ASTNode* node = stack.back();
+		stack.pop_back();
+		if (!node)
+			continue;
+		node->Shift(delta);
+
+		switch(node->GetType())
+		{
+		case AST_ELEMENTS:
+			PushList(stack, ((ElementsNode*)node)->GetElements().GetHead());
+			break;
+		case AST_MAPPING:
+			PushList(stack, ((MappingNode*)node)->GetKeys().GetHead());
+			PushList(stack, ((MappingNode*)node)->GetValues().GetHead());
+			break;
+		case AST_IF:
+		{
+			IfNode* in = (IfNode*)node;
+			stack.push_back(in->GetCondition());
+			PushList(stack, in->GetStatements().GetHead());
+			PushList(stack, in->GetElseStatements().GetHead());
+			break;
+		}
+		case AST_FUNCTION:
+		{
+			FunctionNode* fn = (FunctionNode*)node;
+			stack.push_back(fn->GetFunction());
+			stack.push_back(fn->GetParam());
+			PushList(stack, fn->GetStatements().GetHead());
+			break;
+		}
+		case AST_FOR:
+		{
+			ForNode* fn = (ForNode*)node;
+			stack.push_back(fn->GetIterator());
+			stack.push_back(fn->GetIterList());
+			PushList(stack, fn->GetStatements().GetHead());
+			break;
+		}
+		case AST_WHILE:
+		{
+			WhileNode* wn = (WhileNode*)node;
+			stack.push_back(wn->GetCondition());
+			PushList(stack, wn->GetStatements().GetHead());
+			break;
+		}
+		case AST_RETURN:
+			stack.push_back(((ReturnNode*)node)->GetReturn());
+			break;
+		case AST_ASSIGN:
+		case AST_BOOL:
+		case AST_LOGIC:
+		case AST_CMP:
+		case AST_ADD:
+		case AST_MULTI:
+			stack.push_back(((BinaryNode*)node)->GetLeft());
+			stack.push_back(((BinaryNode*)node)->GetRight());
+			break;
+		case AST_UNARY:
+		case AST_POST:
+			stack.push_back(((UnaryNode*)node)->GetParam());
+			break;
+		case AST_INVOKE:
+			stack.push_back(((InvokeNode*)node)->GetInstance());
+			stack.push_back(((InvokeNode*)node)->GetAttr());
+			break;
+		case AST_CALL:
+			stack.push_back(((CallNode*)node)->GetFunction());
+			stack.push_back(((CallNode*)node)->GetParams());
+			break;
+		case AST_INDEX:
+			stack.push_back(((IndexNode*)node)->GetSource());
+			stack.push_back(((IndexNode*)node)->GetIndex());
+			break;
+		case AST_LIST:
+			stack.push_back(((ListNode*)node)->GetElements());
+			break;
+		case AST_DICT:
+			stack.push_back(((DictNode*)node)->GetMapping());
+			break;
+		default:
+			break;
+		}
 	}
-	else if (MatchToken(TOKEN_DEF))
+}
+
+// Offset of the first token a statement was parsed from, up to opening
+// brackets; calls, attributes and indexes sit at their operator.
+static unsigned int StartOffset(const ASTNode* node)
+{
+	while(true)
 	{
-		tmp = functiondef();
+		switch(node->GetType())
+		{
+		case AST_CALL:
+			node = ((const CallNode*)node)->GetFunction();
+			break;
+		case AST_INVOKE:
+			node = ((const InvokeNode*)node)->GetInstance();
+			break;
+		case AST_INDEX:
+			node = ((const IndexNode*)node)->GetSource();
+			break;
+		default:
+			return node->GetOffset();
+		}
 	}
-	else if (MatchToken(TOKEN_FOR))
+}
+
+// The statement whose first node is at offset starts there, or at the
+// brackets just before it, right after an end of line. Where an edit has
+// joined it to the line above there is no such start, and the size of
+// the buffer is returned.
+TokenIterator Parser::StatementAt(unsigned int offset)
+{
+	const TokenBuffer& tokens = lexer.GetTokens();
+	TokenIterator i = tokens.Find(offset);
+	if (i == tokens.GetSize() || tokens.GetOffset(i) != offset)
+		return tokens.GetSize();
+	while(i > 0 && tokens.GetType(i - 1) == TOKEN_LBRACKETS)
+		--i;
+	if (i > 0 && tokens.GetType(i - 1) != TOKEN_EOL)
+		return tokens.GetSize();
+	return i;
+}
+
+void Parser::Reparse(const TokenEdit& change)
+{
+	depth = 0;
+	size_t used = arena.GetUsed();
+	if (!root || lazy || !complete || 2 * reparsed > used
+		|| !ReparseList(root->statements, change, true))
 	{
-		tmp = forloop();
+		Parse();
+		return;
 	}
-	else if (MatchToken(TOKEN_WHILE))
+	reparsed += arena.GetUsed() - used;
+}
+
+// The statements that overlap the edited lines are parsed again, from the
+// last one starting at or before them. Inside a block the edit has to be
+// followed by an unchanged statement, so that the new ones can be checked
+// to end exactly where it begins; otherwise the caller takes the whole
+// block. A statement that holds the edit alone is first tried from within.
+bool Parser::ReparseList(ParamList& list, const TokenEdit& change, bool top)
+{
+	NodeLink* prev = NULL;
+	NodeLink* at = NULL;
+	for (NodeLink* l = list.GetHead(); l && StartOffset(l->node) <= change.begin; l = l->next)
 	{
-		tmp = whileloop();
+		prev = at;
+		at = l;
+	}
+	NodeLink* stop = (at ? at->next : list.GetHead());
+	unsigned int removed = (at ? 1 : 0);
+	while(stop && StartOffset(stop->node) < change.end)
+	{
+		stop = stop->next;
+		++removed;
+	}
+	if (!top && (!at || !stop))
+		return false;
+
+	if (at && at->next == stop && ReparseBlock(at->node, change))
+	{
+		if (change.delta != 0)
+			ShiftList(stop, change.delta);
+		return true;
+	}
+
+	TokenIterator size = lexer.GetTokens().GetSize();
+	TokenIterator first = (at ? StatementAt(StartOffset(at->node)) : 0);
+	TokenIterator last = (stop ? StatementAt(StartOffset(stop->node) + change.delta) : size);
+	if (first == size || (stop && (last == size || last <= first)))
+		return false;
+
+	ParamList fresh;
+	if (!ReparseRange(first, last, fresh))
+		return false;
+
+	list.Replace(prev, stop, removed, fresh);
+	if (change.delta != 0)
+		ShiftList(stop, change.delta);
+	return true;
+}
+
+bool Parser::ReparseBlock(ASTNode* node, const TokenEdit& change)
+{
+	bool ok = false;
+	++depth;
+	switch(node->GetType())
+	{
+	case AST_IF:
+	{
+		IfNode* in = (IfNode*)node;
+		ok = ReparseList(in->statements, change, false);
+		if (ok && change.delta != 0)
+			ShiftList(in->else_statements.GetHead(), change.delta);
+		else if (!ok)
+			ok = ReparseList(in->else_statements, change, false);
+		break;
+	}
+	case AST_FUNCTION:
+		ok = ReparseList(((FunctionNode*)node)->statements, change, false);
+		break;
+	case AST_FOR:
+		ok = ReparseList(((ForNode*)node)->statements, change, false);
+		break;
+	case AST_WHILE:
+		ok = ReparseList(((WhileNode*)node)->statements, change, false);
+		break;
+	default:
+		break;
+	}
+	--depth;
+	return ok;
+}
+
+// Parses the statements in tokens [first, last) into list. Errors are
+// kept aside, since any of them sends the caller to a wider reparse.
+bool Parser::ReparseRange(TokenIterator first, TokenIterator last, ParamList& list)
+{
+	vector<Diagnostic> errors;
+	vector<Diagnostic>* sink = diagnostics;
+	diagnostics = &errors;
+	panic = false;
+
+	lexer.SetPosition(first);
+	while(errors.empty())
+	{
+		while(lexer.GetPosition() < last && lexer.Peek().GetType() == TOKEN_EOL)
+			lexer.Next();
+		if (lexer.GetPosition() >= last)
+			break;
+		TokenType type = lexer.Peek().GetType();
+		if (type == TOKEN_END || type == TOKEN_ELSE || type == TOKEN_ELIF)
+			break;
+		ASTNode* stat = statement();
+		if (stat)
+			list.Append(arena, stat);
+	}
+
+	diagnostics = sink;
+	panic = false;
+	return errors.empty() && lexer.GetPosition() == last;
+}
+
+// Moves to the end that closes the current block, matching nested
+// blocks by keyword alone.
+void Parser::SkipBlock()
+{
+	int depth = 0;
+	while(!lexer.IsEnd())
+	{
+		switch(lexer.Peek().GetType())
+		{
+		case TOKEN_END:
+			if (depth-- == 0)
+				return;
+			break;
+		case TOKEN_DEF:
+		case TOKEN_IF:
+		case TOKEN_FOR:
+		case TOKEN_WHILE:
+			++depth;
+			break;
+		default:
+			break;
+		}
+		lexer.Next();
+	}
+}
+
+// Splits the program between top-level statements and parses the pieces
+// on the pool. Blocks and brackets are matched on token types alone, so
+// if the split does not hold up, or any piece has an error, this gives up
+// and the program is parsed serially.
+bool Parser::ParseParallel()
+{
+	const TokenBuffer& tokens = lexer.GetTokens();
+	TokenIterator size = tokens.GetSize();
+	TokenIterator chunk = size / (pool->GetSize() * 4);
+	if (chunk < PARALLEL_MIN_CHUNK)
+		chunk = PARALLEL_MIN_CHUNK;
+	if (size < chunk * 2)
+		return false;
+
+	vector<TokenIterator> bounds(1, 0);
+	int blocks = 0, brackets = 0;
+	for (TokenIterator i = 0; i < size; ++i)
+	{
+		switch(tokens.GetType(i))
+		{
+		case TOKEN_DEF:
+		case TOKEN_IF:
+		case TOKEN_FOR:
+		case TOKEN_WHILE:
+			++blocks;
+			break;
+		case TOKEN_END:
+			if (--blocks < 0)
+				return false;
+			break;
+		case TOKEN_LBRACKETS:
+		case TOKEN_LMBRACKETS:
+		case TOKEN_LBBRACKETS:
+			++brackets;
+			break;
+		case TOKEN_RBRACKETS:
+		case TOKEN_RMBRACKETS:
+		case TOKEN_RBBRACKETS:
+			if (--brackets < 0)
+				return false;
+			break;
+		case TOKEN_EOL:
+			if (blocks == 0 && brackets == 0 && i + 1 - bounds.back() >= chunk
+				&& size - (i + 1) >= chunk)
+				bounds.push_back(i + 1);
+			break;
+		default:
+			break;
+		}
+	}
+	if (blocks != 0 || brackets != 0 || bounds.size() < 2)
+		return false;
+	bounds.push_back(size);
+
+	size_t n = bounds.size() - 1;
+	vector<Lexer*> slices(n, NULL);
+	vector<Parser*> parts(n, NULL);
+	vector<vector<Diagnostic> > errors(n);
+	for (size_t i = 0; i < n; ++i)
+	{
+		pool->Submit([this, &bounds, &slices, &parts, &errors, i]()
+		{
+			slices[i] = new Lexer(lexer, bounds[i], bounds[i + 1]);
+			parts[i] = new Parser(*slices[i], &errors[i]);
+			parts[i]->locate = false;
+			parts[i]->explicit_stack = explicit_stack;
+			parts[i]->nesting_limit = nesting_limit;
+			parts[i]->table_driven = table_driven;
+			parts[i]->Parse();
+		});
+	}
+	pool->Wait();
+
+	bool ok = true;
+	for (size_t i = 0; i < n; ++i)
+		ok = ok && errors[i].empty();
+	for (size_t i = 0; i < n; ++i)
+	{
+		if (ok)
+		{
+			const ParamList& list = parts[i]->root->GetStatements();
+			for (const NodeLink* l = list.GetHead(); l; l = l->next)
+				root->AddStatement(arena, l->node);
+			arena.Adopt(parts[i]->arena);
+		}
+		delete parts[i];
+		delete slices[i];
+	}
+
+	if (ok)
+		lexer.SetPosition(size);
+	return ok;
+}
+
+ASTNode* Parser::statement()
+{
+	ASTNode* tmp = NULL;
+
+	if (MatchToken(TOKEN_IF) || MatchToken(TOKEN_DEF) || MatchToken(TOKEN_FOR)
+		|| MatchToken(TOKEN_WHILE))
+	{
+		tmp = blockstat();
 	}
 	else if (MatchToken(TOKEN_RETURN))
 	{
@@ -104,338 +691,484 @@ ASTNode* Parser::statement()
 	else
 	{
 		tmp = assign();
+		EndLine();
 	}
 
 	return tmp;
 }
 
-ASTNode* Parser::ifstat()
+ASTNode* Parser::blockstat()
 {
-	int line = lexer.Peek()->GetLine();
+	if (explicit_stack)
+		return stackblock();
+	if (!Nest(true))
+		return NULL;
 
-	MustMatch(TOKEN_IF);
+	ASTNode* tmp = NULL;
+	switch(lexer.Peek().GetType())
+	{
+	case TOKEN_IF:
+		tmp = ifstat();
+		break;
+	case TOKEN_DEF:
+		tmp = functiondef();
+		break;
+	case TOKEN_FOR:
+		tmp = forloop();
+		break;
+	default:
+		tmp = whileloop();
+		break;
+	}
+
+	--depth;
+	return tmp;
+}
+
+IfNode* Parser::ifhead()
+{
+	unsigned int offset = lexer.Peek().GetOffset();
+
+	// An elif is an if nested as the only else statement; it closes on
+	// the same end as the if it continues.
+	if (MatchToken(TOKEN_ELIF))
+		lexer.Next();
+	else
+		MustMatch(TOKEN_IF);
+
+	IfNode* tmp = arena.New<IfNode>(offset);
+
+	ASTNode* ep = expr();
+	tmp->SetCondition(ep);
+
+	EndLine();
+
+	return tmp;
+}
+
+FunctionNode* Parser::functionhead()
+{
+	unsigned int offset = lexer.Peek().GetOffset();
+
+	MustMatch(TOKEN_DEF);
+
+	FunctionNode* tmp = arena.New<FunctionNode>(offset);
+
+	IdNode* id = identifier("function name");
+	tmp->SetFunction(id);
+
+	MustMatch(TOKEN_LBRACKETS);
+
+	if (!panic && !MatchTokenMultiLine(TOKEN_RBRACKETS))
+	{
+		ElementsNode* elm = elements(TOKEN_RBRACKETS);
+		tmp->SetParam(elm);
+	}
+
+	MustMatch(TOKEN_RBRACKETS);
 
-	IfNode* tmp = new IfNode(line);
-	
-	ExprNode* ep = expr();
+	EndLine();
+
+	return tmp;
+}
+
+ForNode* Parser::forhead()
+{
+	unsigned int offset = lexer.Peek().GetOffset();
+
+	MustMatch(TOKEN_FOR);
+
+	ForNode* tmp = arena.New<ForNode>(offset);
+
+	IdNode* id = identifier("iterator name");
+	tmp->SetIterator(id);
+
+	MustMatch(TOKEN_IN);
+
+	ASTNode* ep = expr();
+	tmp->SetIterList(ep);
+
+	EndLine();
+
+	return tmp;
+}
+
+WhileNode* Parser::whilehead()
+{
+	unsigned int offset = lexer.Peek().GetOffset();
+
+	MustMatch(TOKEN_WHILE);
+
+	WhileNode* tmp = arena.New<WhileNode>(offset);
+
+	ASTNode* ep = expr();
 	tmp->SetCondition(ep);
 
-	MustMatch(TOKEN_EOL);
+	EndLine();
+
+	return tmp;
+}
+
+ASTNode* Parser::ifstat()
+{
+	IfNode* tmp = ifhead();
+
+	while(MoreStatements(true))
+	{
+		ASTNode* stat = statement();
+		if (stat)
+			tmp->AddStatement(arena, stat);
+	}
+
+	if (MatchToken(TOKEN_ELIF))
+	{
+		ASTNode* elif = ifstat();
+		tmp->AddElseStatement(arena, elif);
+		return tmp;
+	}
 
-	while(MatchToken(TOKEN_END) == false)
+	if (MatchToken(TOKEN_ELSE))
 	{
-		if (MatchToken(TOKEN_EOL))
+		lexer.Next();
+		EndLine();
+		while(MoreStatements(false))
 		{
-			lexer.Next();
-			continue;
+			ASTNode* stat = statement();
+			if (stat)
+				tmp->AddElseStatement(arena, stat);
 		}
-		ASTNode* stat = statment();
-		tmp->AddStatement(stat);
 	}
 
 	MustMatch(TOKEN_END);
-	MustMatch(TOKEN_EOL);
+	EndLine();
 
 	return tmp;
 }
 
 ASTNode* Parser::functiondef()
 {
-	int line = lexer.Peek()->GetLine();
+	FunctionNode* tmp = functionhead();
 
-	MustMatch(TOKEN_DEF);
-
-	FunctionNode* tmp = new FunctionNode(line);
-	
-	if (MatchToken(TOKEN_ID))
+	if (lazy)
 	{
-		IdNode* id = new IdNode(lexer.Peek()->GetLine(),
-								lexer.Peek()->GetContent());
-		lexer.Next();
-		tmp->SetFunction(id);
+		tmp->SetBody(this, lexer.GetPosition(), depth);
+		SkipBlock();
 	}
 	else
 	{
-		ostringstream oss;
-		oss << "[Error] Expect function name but "
-			<< lexer.Peek()->GetType() << " at line " << line
-			<< endl;
-		throw ParseException(oss.str());
-	}
-
-	MustMatch(TOKEN_LBRACKETS);
-
-	ElementsNode* elm = elements();
-	tmp->SetParam(elm);
-
-	MustMatch(TOKEN_RBRACKETS);
-
-	MustMatch(TOKEN_EOL);
-
-	while(MatchToken(TOKEN_END) == false)
-	{
-		if (MatchToken(TOKEN_EOL))
+		while(MoreStatements(false))
 		{
-			lexer.Next();
-			continue;
+			ASTNode* stat = statement();
+			if (stat)
+				tmp->AddStatement(arena, stat);
 		}
-		ASTNode* stat = statment();
-		tmp->AddStatement(stat);
 	}
 
 	MustMatch(TOKEN_END);
-	MustMatch(TOKEN_EOL);
+	EndLine();
 
 	return tmp;
 }
 
 ASTNode* Parser::forloop()
 {
-	int line = lexer.Peek()->GetLine();
+	ForNode* tmp = forhead();
 
-	MustMatch(TOKEN_FOR);
-
-	ForNode* tmp = new FunctionNode(line);
-	
-	if (MatchToken(TOKEN_ID))
-	{
-		IdNode* id = new IdNode(lexer.Peek()->GetLine(),
-								lexer.Peek()->GetContent());
-		tmp->SetIterator(id);
-		lexer.Next();
-	}
-	else
+	while(MoreStatements(false))
 	{
-		ostringstream oss;
-		oss << "[Error] Expect function name but "
-			<< lexer.Peek()->GetType() << " at line " << line
-			<< endl;
-		throw ParseException(oss.str());
+		ASTNode* stat = statement();
+		if (stat)
+			tmp->AddStatement(arena, stat);
 	}
 
-	MustMatch(TOKEN_IN);
+	MustMatch(TOKEN_END);
+	EndLine();
 
-	ExprNode* ep = expr();
-	tmp->SetIterList(ep);
+	return tmp;
+}
 
-	MustMatch(TOKEN_EOL);
+ASTNode* Parser::whileloop()
+{
+	WhileNode* tmp = whilehead();
 
-	while(MatchToken(TOKEN_END) == false)
+	while(MoreStatements(false))
 	{
-		if (MatchToken(TOKEN_EOL))
-		{
-			lexer.Next();
-			continue;
-		}
-		ASTNode* stat = statment();
-		tmp->AddStatement(stat);
+		ASTNode* stat = statement();
+		if (stat)
+			tmp->AddStatement(arena, stat);
 	}
 
 	MustMatch(TOKEN_END);
-	MustMatch(TOKEN_EOL);
+	EndLine();
 
 	return tmp;
 }
 
-ASTNode* Parser::whileloop()
+// Reads the header of the block starting here and leaves it open on the
+// block stack; a lazy function is skipped to its end straight away.
+ASTNode* Parser::OpenBlock()
 {
-	int line = lexer.Peek()->GetLine();
+	if (!Nest(true))
+		return NULL;
 
-	MustMatch(TOKEN_WHILE);
+	BlockFrame frame = { NULL, false };
+	switch(lexer.Peek().GetType())
+	{
+	case TOKEN_IF:
+		frame.node = ifhead();
+		break;
+	case TOKEN_DEF:
+	{
+		FunctionNode* fn = functionhead();
+		frame.node = fn;
+		if (lazy)
+		{
+			fn->SetBody(this, lexer.GetPosition(), depth);
+			SkipBlock();
+			MustMatch(TOKEN_END);
+			EndLine();
+			--depth;
+			return fn;
+		}
+		break;
+	}
+	case TOKEN_FOR:
+		frame.node = forhead();
+		break;
+	default:
+		frame.node = whilehead();
+		break;
+	}
 
-	WhileNode* tmp = new WhileNode(line);
+	open.push_back(frame);
+	return frame.node;
+}
 
-	ExprNode* ep = expr();
-	tmp->SetCondition(ep);
+void Parser::AddToBlock(const BlockFrame& frame, ASTNode* node)
+{
+	switch(frame.node->GetType())
+	{
+	case AST_IF:
+		if (frame.else_part)
+			((IfNode*)frame.node)->AddElseStatement(arena, node);
+		else
+			((IfNode*)frame.node)->AddStatement(arena, node);
+		break;
+	case AST_FUNCTION:
+		((FunctionNode*)frame.node)->AddStatement(arena, node);
+		break;
+	case AST_FOR:
+		((ForNode*)frame.node)->AddStatement(arena, node);
+		break;
+	default:
+		((WhileNode*)frame.node)->AddStatement(arena, node);
+		break;
+	}
+}
 
-	MustMatch(TOKEN_EOL);
+// The blocks above as a loop over the stack of open ones. A nested block
+// joins its parent as soon as its header is read, since statements are
+// appended in order either way, and an elif takes over the frame of the
+// if it continues.
+ASTNode* Parser::stackblock()
+{
+	size_t base = open.size();
+	ASTNode* top = OpenBlock();
 
-	while(MatchToken(TOKEN_END) == false)
+	while(open.size() > base)
 	{
-		if (MatchToken(TOKEN_EOL))
+		size_t at = open.size() - 1;
+		bool then_part = (open[at].node->GetType() == AST_IF && !open[at].else_part);
+		if (MoreStatements(then_part))
+		{
+			TokenType type = lexer.Peek().GetType();
+			ASTNode* stat;
+			if (type == TOKEN_IF || type == TOKEN_DEF || type == TOKEN_FOR || type == TOKEN_WHILE)
+				stat = OpenBlock();
+			else
+				stat = statement();
+			if (stat)
+				AddToBlock(open[at], stat);
+			continue;
+		}
+
+		if (then_part && MatchToken(TOKEN_ELIF))
+		{
+			IfNode* elif = ifhead();
+			((IfNode*)open[at].node)->AddElseStatement(arena, elif);
+			open[at].node = elif;
+			continue;
+		}
+		if (then_part && MatchToken(TOKEN_ELSE))
 		{
 			lexer.Next();
+			EndLine();
+			open[at].else_part = true;
 			continue;
 		}
-		ASTNode* stat = statment();
-		tmp->AddStatement(stat);
-	}
 
-	MustMatch(TOKEN_END);
-	MustMatch(TOKEN_EOL);
+		MustMatch(TOKEN_END);
+		EndLine();
+		open.pop_back();
+		--depth;
+	}
 
-	return tmp;
+	return top;
 }
 
 ASTNode* Parser::breakstat()
 {
-	int line = lexer.Peek()->GetLine();
+	unsigned int offset = lexer.Peek().GetOffset();
 
 	MustMatch(TOKEN_BREAK);
 
-	BreakNode* tmp = new BreakNode(line);
+	BreakNode* tmp = arena.New<BreakNode>(offset);
 
-	MustMatch(TOKEN_EOL);
+	EndLine();
 
 	return tmp;
 }
 
 ASTNode* Parser::continuestat()
 {
-	int line = lexer.Peek()->GetLine();
+	unsigned int offset = lexer.Peek().GetOffset();
 
 	MustMatch(TOKEN_CONTINUE);
 
-	ContinueNode* tmp = new ContinueNode(line);
+	ContinueNode* tmp = arena.New<ContinueNode>(offset);
 
-	MustMatch(TOKEN_EOL);
+	EndLine();
 
 	return tmp;
 }
 
 ASTNode* Parser::returnstat()
 {
-	int line = lexer.Peek()->GetLine();
+	unsigned int offset = lexer.Peek().GetOffset();
 
 	MustMatch(TOKEN_RETURN);
 
-	ReturnNode* tmp = new ReturnNode(line);
-
-	ExprNode* ep = expr();
-	tmp->SetReturn(ep);
-
-	MustMatch(TOKEN_EOL);
-
-	return tmp;
-}
-
-ASTNode* Parser::assign()
-{
-	int line = lexer.Peek()->GetLine();
+	ReturnNode* tmp = arena.New<ReturnNode>(offset);
 
-	TokenIterator it = lexer.Peek();
-
-	ASTNode* tmp;
-	ASTNode* ue = unaryexpr();
-	if (MatchToken(TokenType::TOKEN_PLUS_ASSIGN))
+	if (!MatchToken(TOKEN_EOL))
 	{
-		ASTNode* as = new AssignNode(lexer.Get()->GetType(), line);
-		as->SetLeft(ue);
-		ASTNode* rv = assign();
-		as->SetRight(rv);
-		tmp = as;
-	}
-	else
-	{
-		delete ue;
-		lexer.SetPosition(it);
-		ASTNode* ex = expr();
-		tmp = ex;
+		ASTNode* ep = expr();
+		tmp->SetReturn(ep);
 	}
 
-	MustMatch(TOKEN_EOL);
+	EndLine();
+
 	return tmp;
 }
 
-ASTNode* Parser::expr()
+static bool IsAssignOperator(TokenType type)
 {
-	int line = lexer.Peek()->GetLine();
-	ASTNode* tmp = boolexpr();
-
-	if (MatchToken(TokenType::TOKEN_AND)
-		|| MatchToken(TokenType::TOKEN_OR)
-		|| MatchToken(TokenType::TOKEN_EQUAL)
-		|| MatchToken(TokenType::TOKEN_NOT)
-		|| MatchToken(TokenType::TOKEN_NOT_EQUAL))
+	switch(type)
 	{
-		BoolNode* bl = new BoolNode(lexer.Get()->GetType(), line);
-		bl->SetLeft(tmp);
-		tmp = expr();
-		bl->SetRight(tmp);
-
-		return bl;
+	case TOKEN_ASSIGN:
+	case TOKEN_PLUS_ASSIGN:
+	case TOKEN_MINUS_ASSIGN:
+	case TOKEN_MULTI_ASSIGN:
+	case TOKEN_DIV_ASSIGN:
+	case TOKEN_MOD_ASSIGN:
+	case TOKEN_BIT_AND_ASSIGN:
+	case TOKEN_BIT_OR_ASSIGN:
+	case TOKEN_BIT_XOR_ASSIGN:
+	case TOKEN_BIT_NOT_ASSIGN:
+		return true;
+	default:
+		return false;
 	}
-
-	return tmp;
 }
 
-ASTNode* Parser::boolexpr()
+bool Parser::IsAssignable(const ASTNode* node)
 {
-	int line = lexer.Peek()->GetLine();
-	ASTNode* tmp = logicexpr();
-
-	if (MatchToken(TokenType::TOKEN_BIT_AND)
-		|| MatchToken(TokenType::TOKEN_BIT_OR)
-		|| MatchToken(TokenType::TOKEN_BIT_XOR))
-	{
-		LogicNode* ln = new LogicNode(lexer.Get()->GetType(), line);
-		ln->SetLeft(tmp);
-		tmp = boolexpr();
-		ln->SetRight(tmp);
-
-		return ln;
-	}
-
-	return tmp;
+	ASTType type = node->GetType();
+	return type == AST_ID || type == AST_INDEX || type == AST_INVOKE;
 }
 
-ASTNode* Parser::logicexpr()
+// The left side is parsed once as an expression and becomes the target
+// if an assignment operator follows; assignments chain to the right.
+ASTNode* Parser::assign()
 {
-	int line = lexer.Peek()->GetLine();
-	ASTNode* tmp = cmpexpr();
+	unsigned int offset = lexer.Peek().GetOffset();
 
-	if (MatchToken(TokenType::TOKEN_EQUAL)
-		|| MatchToken(TokenType::TOKEN_NOT_EQUAL)
-		|| MatchToken(TokenType::TOKEN_MORE)
-		|| MatchToken(TokenType::TOKEN_GE)
-		|| MatchToken(TokenType::TOKEN_LESS)
-		|| MatchToken(TokenType::TOKEN_LE))
+	ASTNode* tmp = expr();
+	if (!panic && IsAssignOperator(PeekType()))
 	{
-		CompareNode* cn = new CompareNode(lexer.Get()->GetType(), line);
-		cn->SetLeft(tmp);
-		tmp = logicexpr();
-		cn->SetRight(tmp);
-
-		return cn;
+		if (!IsAssignable(tmp))
+			Error("assignable target");
+		AssignNode* as = arena.New<AssignNode>(lexer.Get().GetType(), offset);
+		as->SetLeft(tmp);
+		ASTNode* rv = assign();
+		as->SetRight(rv);
+		tmp = as;
 	}
 
 	return tmp;
 }
 
-ASTNode* Parser::cmpexpr()
+// Binding power of each infix operator and the node it builds; zero means
+// the token does not continue an expression.
+struct BindingPower
 {
-	int line = lexer.Peek()->GetLine();
-	ASTNode* tmp = addexpr();
-
-	if (MatchToken(TokenType::TOKEN_PLUS)
-		|| MatchToken(TokenType::TOKEN_MINUS))
-	{
-		AddNode* an = new AddNode(lexer.Get()->GetType(), line);
-		an->SetLeft(tmp);
-		tmp = cmpexpr();
-		an->SetRight(tmp);
+	unsigned char power;
+	ASTType type;
+};
 
-		return an;
-	}
+struct BindingTable
+{
+	BindingPower entries[TOKEN_UNKNOWN + 1];
+};
 
-	return tmp;
+static constexpr BindingTable MakeBindingTable()
+{
+	BindingTable t = {};
+	t.entries[TOKEN_AND] = { 1, AST_BOOL };
+	t.entries[TOKEN_OR] = { 1, AST_BOOL };
+	t.entries[TOKEN_BIT_AND] = { 2, AST_LOGIC };
+	t.entries[TOKEN_BIT_OR] = { 2, AST_LOGIC };
+	t.entries[TOKEN_BIT_XOR] = { 2, AST_LOGIC };
+	t.entries[TOKEN_EQUAL] = { 3, AST_CMP };
+	t.entries[TOKEN_NOT_EQUAL] = { 3, AST_CMP };
+	t.entries[TOKEN_MORE] = { 3, AST_CMP };
+	t.entries[TOKEN_GE] = { 3, AST_CMP };
+	t.entries[TOKEN_LESS] = { 3, AST_CMP };
+	t.entries[TOKEN_LE] = { 3, AST_CMP };
+	t.entries[TOKEN_PLUS] = { 4, AST_ADD };
+	t.entries[TOKEN_MINUS] = { 4, AST_ADD };
+	t.entries[TOKEN_MULTI] = { 5, AST_MULTI };
+	t.entries[TOKEN_DIV] = { 5, AST_MULTI };
+	t.entries[TOKEN_MOD] = { 5, AST_MULTI };
+	return t;
 }
 
-ASTNode* Parser::addexpr()
+static constexpr BindingTable BINDING_TABLE = MakeBindingTable();
+
+// Precedence climbing: operators at the same level fold into the left
+// operand in a loop, so a flat chain is left associative and recursion
+// only goes as deep as the number of levels.
+ASTNode* Parser::expr(unsigned int power)
 {
-	int line = lexer.Peek()->GetLine();
+	if (explicit_stack)
+		return stackexpr(power);
+	if (panic)
+		return NULL;
+
+	unsigned int offset = lexer.Peek().GetOffset();
 	ASTNode* tmp = unaryexpr();
 
-	if (MatchToken(TokenType::TOKEN_MULTI)
-		|| MatchToken(TokenType::TOKEN_DIV)
-		|| MatchToken(TokenType::TOKEN_MOD))
+	while(!panic)
 	{
-		MultiNode* mn = new MultiNode(lexer.Get()->GetType(), line);
-		mn->SetLeft(tmp);
-		tmp = addexpr();
-		mn->SetRight(tmp);
+		const BindingPower& bp = BINDING_TABLE.entries[PeekType()];
+		if (bp.power < power)
+			break;
 
-		return mn;
+		BinaryNode* bn = arena.New<BinaryNode>(bp.type, lexer.Get().GetType(), offset);
+		bn->SetLeft(tmp);
+		ASTNode* right = expr(bp.power + 1);
+		bn->SetRight(right);
+		tmp = bn;
 	}
 
 	return tmp;
@@ -443,91 +1176,86 @@ ASTNode* Parser::addexpr()
 
 ASTNode* Parser::unaryexpr()
 {
-	int line = lexer.Peek()->GetLine();
-	
-	ASTNode* tmp;
+	unsigned int offset = lexer.Peek().GetOffset();
 
-	if (MatchToken(TokenType::TOKEN_INC)
-		|| MatchToken(TokenType::TOKEN_DEC)
-		|| MatchToken(TokenType::TOKEN_PLUS)
-		|| MatchToken(TokenType::TOKEN_MINUS)
-		|| MatchToken(TokenType::TOKEN_NOT)
-		|| MatchToken(TokenType::TOKEN_BIT_NOT))
+	switch(PeekType())
+	{
+	case TOKEN_INC:
+	case TOKEN_DEC:
+	case TOKEN_PLUS:
+	case TOKEN_MINUS:
+	case TOKEN_NOT:
+	case TOKEN_BIT_NOT:
 	{
-		tmp = new PreUnaryNode(lexer.Get()->GetType, line);
+		PreUnaryNode* pn = arena.New<PreUnaryNode>(lexer.Get().GetType(), offset);
 		ASTNode* ue = unaryexpr();
-		tmp->SetParam(ue);
+		pn->SetParam(ue);
+		return pn;
 	}
-	else
-	{
-		tmp = postexpr();
+	default:
+		return postexpr();
 	}
-
-	return tmp;
 }
 
 ASTNode* Parser::postexpr()
 {
-	int line = lexer.Peek()->GetLine();
-	
+	unsigned int offset = lexer.Peek().GetOffset();
+
 	ASTNode* tmp = priexpr();
 
-	while(true)
+	while(!panic)
 	{
-		if (MatchToken(TokenType::TOKEN_INC)
-			|| MatchToken(TokenType::TOKEN_DEC))
+		switch(PeekType())
 		{
-			PostUnaryNode* pn = new PostUnaryNode(lexer.Get()->GetType, line);
+		case TOKEN_INC:
+		case TOKEN_DEC:
+		{
+			PostUnaryNode* pn = arena.New<PostUnaryNode>(lexer.Get().GetType(), offset);
 			pn->SetParam(tmp);
 			tmp = pn;
+			break;
 		}
-		else if (MatchToken(TokenType::TOKEN_INVOKE))
+		case TOKEN_INVOKE:
 		{
-			InvokeNode* in = new InvokeNode(line);
+			InvokeNode* in = arena.New<InvokeNode>(lexer.Get().GetOffset());
 			in->SetInstance(tmp);
-			lexer.Next();
-			if (MatchToken(TokenType::TOKEN_ID))
-			{
-				IdNode* id = new IdNode(lexer.Peek()->GetLine(),
-								lexer.Peek()->GetContent());
-				in->SetAttr(id);
-				lexer.Next();
-				tmp = in;
-			}
-			else
-			{
-				ostringstream oss;
-				oss << "[Error] Expect attibute name but "
-					<< lexer.Get()->GetType() << " at line " << line
-					<< endl;
-				throw ParseException(oss.str());
-			}
+			IdNode* id = identifier("attribute name");
+			in->SetAttr(id);
+			tmp = in;
+			break;
 		}
-		else if (MatchToken(TOKEN_LBRACKETS))
+		case TOKEN_LBRACKETS:
 		{
-			ASTNode* cn = new CallNode(lexer.Get()->GetLine());
+			if (!Nest(false))
+				return tmp;
+			CallNode* cn = arena.New<CallNode>(lexer.Get().GetOffset());
 			cn->SetFunction(tmp);
-			if (!MatchToken(TOKEN_RBRACKETS))
+			if (!MatchTokenMultiLine(TOKEN_RBRACKETS))
 			{
-				ASTNode* elm = elements();
+				ElementsNode* elm = elements(TOKEN_RBRACKETS);
 				cn->SetParams(elm);
 			}
 			MustMatch(TOKEN_RBRACKETS);
+			--depth;
 			tmp = cn;
+			break;
 		}
-		else if (MatchToken(TOKEN_LMBRACKETS))
+		case TOKEN_LMBRACKETS:
 		{
-			ASTNode* in = new IndexNode(lexer.Get()->GetLine());
+			if (!Nest(false))
+				return tmp;
+			IndexNode* in = arena.New<IndexNode>(lexer.Get().GetOffset());
 			in->SetSource(tmp);
 			ASTNode* idx = expr();
 			in->SetIndex(idx);
 			MustMatch(TOKEN_RMBRACKETS);
+			--depth;
 			tmp = in;
-		}
-		else
-		{
 			break;
 		}
+		default:
+			return tmp;
+		}
 	}
 
 	return tmp;
@@ -535,13 +1263,16 @@ ASTNode* Parser::postexpr()
 
 ASTNode* Parser::priexpr()
 {
-	int line = lexer.Peek()->GetLine();
-	
 	ASTNode* tmp;
 
-	if (MatchToken(TokenType::TOKEN_LBRACKETS))
+	if (MatchToken(TOKEN_LBRACKETS))
 	{
+		if (!Nest(false))
+			return NULL;
+		lexer.Next();
 		tmp = expr();
+		MustMatch(TOKEN_RBRACKETS);
+		--depth;
 	}
 	else
 	{
@@ -553,116 +1284,658 @@ ASTNode* Parser::priexpr()
 
 ASTNode* Parser::variable()
 {
-	int line = lexer.Peek()->GetLine();
-	
-	ASTNode* tmp;
-
-	if (MatchToken(TokenType::TOKEN_ID))
+	switch(PeekType())
 	{
-		tmp = new IdNode(lexer.Peek()->GetLine(),
-						lexer.Peek()->GetContent());
-		lexer.Next();
-	}
-	else if (MatchToken(TokenType::TOKEN_STRING))
+	case TOKEN_ID:
+		return identifier("variable name");
+	case TOKEN_STRING:
 	{
-		tmp = new StringNode(lexer.Peek()->GetLine(),
-						lexer.Peek()->GetContent());
-		lexer.Next();
+		Token token = lexer.Get();
+		string_view text = token.GetText();
+		return arena.New<StringNode>(token.GetOffset(),
+			string_view(arena.Copy(text.data(), text.size()), text.size()));
 	}
-	else if (MatchToken(TokenType::TOKEN_INT))
+	case TOKEN_INT:
 	{
-		tmp = new IntNode(lexer.Peek()->GetLine(),
-						lexer.Peek()->GetContent());
-		lexer.Next();
+		Token token = lexer.Get();
+		return arena.New<IntNode>(token.GetOffset(), token.GetInt());
 	}
-	else if (MatchToken(TokenType::TOKEN_FLOAT))
+	case TOKEN_FLOAT:
 	{
-		tmp = new FloatNode(lexer.Peek()->GetLine(),
-						lexer.Peek()->GetContent());
-		lexer.Next();
+		Token token = lexer.Get();
+		return arena.New<FloatNode>(token.GetOffset(), token.GetFloat());
 	}
-	else if (MatchToken(TokenType::TOKEN_LMBRACKETS))
+	case TOKEN_LMBRACKETS:
 	{
-		tmp = new ListNode(lexer.Get()->GetLine());
-		if (!MatchToken(TokenType::TOKEN_RMBRACKETS))
+		if (!Nest(false))
+			return NULL;
+		ListNode* ln = arena.New<ListNode>(lexer.Get().GetOffset());
+		if (!MatchTokenMultiLine(TOKEN_RMBRACKETS))
 		{
-			ElementsNode* elm = elements();
-			tmp->SetElements(elm);
+			ElementsNode* elm = elements(TOKEN_RMBRACKETS);
+			ln->SetElements(elm);
 		}
-		MustMatch(TokenType::TOKEN_RMBRACKETS);
+		MustMatch(TOKEN_RMBRACKETS);
+		--depth;
+		return ln;
 	}
-	else if (MatchToken(TokenType::TOKEN_LLBRACKETS))
+	case TOKEN_LBBRACKETS:
 	{
-		tmp = new DictNode(lexer.Get()->GetLine());
-		if (!MatchToken(TokenType::TOKEN_RLBRACKETS))
+		if (!Nest(false))
+			return NULL;
+		DictNode* dn = arena.New<DictNode>(lexer.Get().GetOffset());
+		if (!MatchTokenMultiLine(TOKEN_RBBRACKETS))
 		{
 			MappingNode* mn = mapping();
-			tmp->SetMapping(mn);
+			dn->SetMapping(mn);
 		}
-		MustMatch(TokenType::TOKEN_RLBRACKETS);
+		MustMatch(TOKEN_RBBRACKETS);
+		--depth;
+		return dn;
 	}
-	else
-	{
-		ostringstream oss;
-		oss << "[Error] Expect variable name but "
-			<< lexer.Get()->GetType() << " at line " << line
-			<< endl;
-		throw ParseException(oss.str());
+	default:
+		Error("variable name");
+		return NULL;
 	}
-
-	return tmp;
 }
 
-ASTNode* Parser::elements()
+ElementsNode* Parser::elements(TokenType close)
 {
-	int line = lexer.Peek()->GetLine();
-	
-	ASTNode* tmp = new ElementsNode(line);
+	// The caller's check for close may have run into the end of input.
+	if (panic)
+		return NULL;
 
-	while(MatchToken(TokenType::TOKEN_EOL))
-		lexer.Next();
+	unsigned int offset = lexer.Peek().GetOffset();
 
-	ASTNode* ep = expr();
-	tmp->AddElement(ep);
-	if (MatchTokenMultiLine(TokenType::TOKEN_COMMA))
+	ElementsNode* tmp = arena.New<ElementsNode>(offset);
+
+	while(MatchToken(TOKEN_EOL))
 		lexer.Next();
 
-	while(!MatchTokenMultiLine(TokenType::TOKEN_RMBRACKETS))
+	do
 	{
-		ep = expr();
-		tmp->AddElement(ep);
-		if (MatchTokenMultiLine(TokenType::TOKEN_COMMA))
+		ASTNode* ep = expr();
+		if (panic)
+			break;
+		tmp->AddElement(arena, ep);
+		if (MatchTokenMultiLine(TOKEN_COMMA))
 			lexer.Next();
-	}
+	} while(!MatchTokenMultiLine(close));
 
 	return tmp;
 }
 
-ASTNode* Parser::mapping()
+MappingNode* Parser::mapping()
 {
-	int line = lexer.Peek()->GetLine();
-	
-	ASTNode* tmp = new MappingNode(line);
+	if (panic)
+		return NULL;
 
-	while(MatchToken(TokenType::TOKEN_EOL))
-		lexer.Next();
+	unsigned int offset = lexer.Peek().GetOffset();
 
-	ASTNode* key = expr();
-	MustMatch(TokenType::TOKEN_COLON);
-	ASTNode* val = expr();
-	tmp->AddMapping(key, val);
-	if (MatchTokenMultiLine(TokenType::TOKEN_COMMA))
+	MappingNode* tmp = arena.New<MappingNode>(offset);
+
+	while(MatchToken(TOKEN_EOL))
 		lexer.Next();
 
-	while(!MatchTokenMultiLine(TokenType::TOKEN_RLBRACKETS))
+	do
 	{
-		key = expr();
-		MustMatch(TokenType::TOKEN_COLON);
-		val = expr();
-		tmp->AddMapping(key, val);
-		if (MatchTokenMultiLine(TokenType::TOKEN_COMMA))
+		ASTNode* key = expr();
+		MustMatch(TOKEN_COLON);
+		ASTNode* val = expr();
+		if (panic)
+			break;
+		tmp->AddMapping(arena, key, val);
+		if (MatchTokenMultiLine(TOKEN_COMMA))
 			lexer.Next();
-	}
+	} while(!MatchTokenMultiLine(TOKEN_RBBRACKETS));
 
 	return tmp;
-}
\ No newline at end of file
+}
+
+enum FrameKind : unsigned char {
+	FRAME_EXPR = 0, FRAME_PREUNARY, FRAME_POSTFIX, FRAME_PAREN, FRAME_CALL,
+	FRAME_INDEX, FRAME_LIST, FRAME_DICT, FRAME_ELEMENT, FRAME_KEY, FRAME_VALUE
+};
+
+static bool IsPrefixOperator(TokenType type)
+{
+	switch(type)
+	{
+	case TOKEN_INC:
+	case TOKEN_DEC:
+	case TOKEN_PLUS:
+	case TOKEN_MINUS:
+	case TOKEN_NOT:
+	case TOKEN_BIT_NOT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+// expr and everything below it as one loop. Where those functions call
+// down, a frame for the rest of the caller is pushed and the loop starts
+// on the inner expression; each finished node is handed to the frame on
+// top. A frame keeps what the call kept in locals: the binding power and
+// start offset of an expression, and the node waiting for its operand,
+// elements or index.
+ASTNode* Parser::stackexpr(unsigned int power)
+{
+	size_t base = work.size();
+	ASTNode* value = NULL;
+	bool start = true;
+
+	// As in elements and mapping, nothing is opened once the check for the
+	// closing bracket has run into the end of input; the frame below then
+	// gets no node.
+	auto open_elements = [this](TokenType close)
+	{
+		if (panic)
+			return;
+		ElementsNode* el = arena.New<ElementsNode>(lexer.Peek().GetOffset());
+		while(MatchToken(TOKEN_EOL))
+			lexer.Next();
+		ParseFrame f = { FRAME_ELEMENT, (unsigned char)close, 0, el, NULL };
+		work.push_back(f);
+	};
+	auto open_mapping = [this]()
+	{
+		if (panic)
+			return;
+		MappingNode* mn = arena.New<MappingNode>(lexer.Peek().GetOffset());
+		while(MatchToken(TOKEN_EOL))
+			lexer.Next();
+		ParseFrame f = { FRAME_KEY, 0, 0, mn, NULL };
+		work.push_back(f);
+	};
+
+	while(true)
+	{
+		if (start)
+		{
+			start = false;
+			value = NULL;
+			if (!panic)
+			{
+				ParseFrame ef = { FRAME_EXPR, (unsigned char)power, lexer.Peek().GetOffset(), NULL, NULL };
+				work.push_back(ef);
+				while(IsPrefixOperator(PeekType()))
+				{
+					Token token = lexer.Get();
+					ParseFrame uf = { FRAME_PREUNARY, 0, 0,
+						arena.New<PreUnaryNode>(token.GetType(), token.GetOffset()), NULL };
+					work.push_back(uf);
+				}
+				ParseFrame pf = { FRAME_POSTFIX, 0, lexer.Peek().GetOffset(), NULL, NULL };
+				work.push_back(pf);
+
+				if (MatchToken(TOKEN_LBRACKETS))
+				{
+					if (Nest(false))
+					{
+						lexer.Next();
+						ParseFrame f = { FRAME_PAREN, 0, 0, NULL, NULL };
+						work.push_back(f);
+						power = 1;
+						start = true;
+					}
+				}
+				else
+				{
+					switch(PeekType())
+					{
+					case TOKEN_ID:
+						value = identifier("variable name");
+						break;
+					case TOKEN_STRING:
+					{
+						Token token = lexer.Get();
+						string_view text = token.GetText();
+						value = arena.New<StringNode>(token.GetOffset(),
+							string_view(arena.Copy(text.data(), text.size()), text.size()));
+						break;
+					}
+					case TOKEN_INT:
+					{
+						Token token = lexer.Get();
+						value = arena.New<IntNode>(token.GetOffset(), token.GetInt());
+						break;
+					}
+					case TOKEN_FLOAT:
+					{
+						Token token = lexer.Get();
+						value = arena.New<FloatNode>(token.GetOffset(), token.GetFloat());
+						break;
+					}
+					case TOKEN_LMBRACKETS:
+					{
+						if (!Nest(false))
+							break;
+						ListNode* ln = arena.New<ListNode>(lexer.Get().GetOffset());
+						if (!MatchTokenMultiLine(TOKEN_RMBRACKETS))
+						{
+							ParseFrame f = { FRAME_LIST, 0, 0, ln, NULL };
+							work.push_back(f);
+							open_elements(TOKEN_RMBRACKETS);
+							power = 1;
+							start = true;
+							break;
+						}
+						MustMatch(TOKEN_RMBRACKETS);
+						--depth;
+						value = ln;
+						break;
+					}
+					case TOKEN_LBBRACKETS:
+					{
+						if (!Nest(false))
+							break;
+						DictNode* dn = arena.New<DictNode>(lexer.Get().GetOffset());
+						if (!MatchTokenMultiLine(TOKEN_RBBRACKETS))
+						{
+							ParseFrame f = { FRAME_DICT, 0, 0, dn, NULL };
+							work.push_back(f);
+							open_mapping();
+							power = 1;
+							start = true;
+							break;
+						}
+						MustMatch(TOKEN_RBBRACKETS);
+						--depth;
+						value = dn;
+						break;
+					}
+					default:
+						Error("variable name");
+						break;
+					}
+				}
+				if (start)
+					continue;
+			}
+		}
+
+		while(!start)
+		{
+			if (work.size() == base)
+				return value;
+
+			ParseFrame& f = work.back();
+			switch(f.kind)
+			{
+			case FRAME_EXPR:
+			{
+				if (f.node)
+				{
+					((BinaryNode*)f.node)->SetRight(value);
+					value = f.node;
+					f.node = NULL;
+				}
+				if (!panic)
+				{
+					const BindingPower& bp = BINDING_TABLE.entries[PeekType()];
+					if (bp.power >= f.power)
+					{
+						BinaryNode* bn = arena.New<BinaryNode>(bp.type, lexer.Get().GetType(), f.offset);
+						bn->SetLeft(value);
+						f.node = bn;
+						power = bp.power + 1;
+						start = true;
+						break;
+					}
+				}
+				work.pop_back();
+				break;
+			}
+			case FRAME_PREUNARY:
+				((PreUnaryNode*)f.node)->SetParam(value);
+				value = f.node;
+				work.pop_back();
+				break;
+			case FRAME_POSTFIX:
+			{
+				unsigned int offset = f.offset;
+				ASTNode* tmp = value;
+				bool done = false;
+				while(!done && !panic)
+				{
+					switch(PeekType())
+					{
+					case TOKEN_INC:
+					case TOKEN_DEC:
+					{
+						PostUnaryNode* pn = arena.New<PostUnaryNode>(lexer.Get().GetType(), offset);
+						pn->SetParam(tmp);
+						tmp = pn;
+						break;
+					}
+					case TOKEN_INVOKE:
+					{
+						InvokeNode* in = arena.New<InvokeNode>(lexer.Get().GetOffset());
+						in->SetInstance(tmp);
+						IdNode* id = identifier("attribute name");
+						in->SetAttr(id);
+						tmp = in;
+						break;
+					}
+					case TOKEN_LBRACKETS:
+					{
+						if (!Nest(false))
+							break;
+						CallNode* cn = arena.New<CallNode>(lexer.Get().GetOffset());
+						cn->SetFunction(tmp);
+						if (!MatchTokenMultiLine(TOKEN_RBRACKETS))
+						{
+							ParseFrame cf = { FRAME_CALL, 0, 0, cn, NULL };
+							work.push_back(cf);
+							open_elements(TOKEN_RBRACKETS);
+							power = 1;
+							start = done = true;
+							break;
+						}
+						MustMatch(TOKEN_RBRACKETS);
+						--depth;
+						tmp = cn;
+						break;
+					}
+					case TOKEN_LMBRACKETS:
+					{
+						if (!Nest(false))
+							break;
+						IndexNode* in = arena.New<IndexNode>(lexer.Get().GetOffset());
+						in->SetSource(tmp);
+						ParseFrame xf = { FRAME_INDEX, 0, 0, in, NULL };
+						work.push_back(xf);
+						power = 1;
+						start = done = true;
+						break;
+					}
+					default:
+						done = true;
+						break;
+					}
+				}
+				if (!start)
+				{
+					value = tmp;
+					work.pop_back();
+				}
+				break;
+			}
+			case FRAME_PAREN:
+				MustMatch(TOKEN_RBRACKETS);
+				--depth;
+				work.pop_back();
+				break;
+			case FRAME_CALL:
+			{
+				CallNode* cn = (CallNode*)f.node;
+				cn->SetParams((ElementsNode*)value);
+				MustMatch(TOKEN_RBRACKETS);
+				--depth;
+				value = cn;
+				work.pop_back();
+				break;
+			}
+			case FRAME_INDEX:
+			{
+				IndexNode* in = (IndexNode*)f.node;
+				in->SetIndex(value);
+				MustMatch(TOKEN_RMBRACKETS);
+				--depth;
+				value = in;
+				work.pop_back();
+				break;
+			}
+			case FRAME_LIST:
+			{
+				ListNode* ln = (ListNode*)f.node;
+				ln->SetElements((ElementsNode*)value);
+				MustMatch(TOKEN_RMBRACKETS);
+				--depth;
+				value = ln;
+				work.pop_back();
+				break;
+			}
+			case FRAME_DICT:
+			{
+				DictNode* dn = (DictNode*)f.node;
+				dn->SetMapping((MappingNode*)value);
+				MustMatch(TOKEN_RBBRACKETS);
+				--depth;
+				value = dn;
+				work.pop_back();
+				break;
+			}
+			case FRAME_ELEMENT:
+			{
+				ElementsNode* el = (ElementsNode*)f.node;
+				if (!panic)
+				{
+					el->AddElement(arena, value);
+					if (MatchTokenMultiLine(TOKEN_COMMA))
+						lexer.Next();
+					if (!MatchTokenMultiLine((TokenType)f.power))
+					{
+						power = 1;
+						start = true;
+						break;
+					}
+				}
+				value = el;
+				work.pop_back();
+				break;
+			}
+			case FRAME_KEY:
+				MustMatch(TOKEN_COLON);
+				f.kind = FRAME_VALUE;
+				f.key = value;
+				power = 1;
+				start = true;
+				break;
+			default:
+			{
+				MappingNode* mn = (MappingNode*)f.node;
+				if (!panic)
+				{
+					mn->AddMapping(arena, f.key, value);
+					if (MatchTokenMultiLine(TOKEN_COMMA))
+						lexer.Next();
+					if (!MatchTokenMultiLine(TOKEN_RBBRACKETS))
+					{
+						f.kind = FRAME_KEY;
+						power = 1;
+						start = true;
+						break;
+					}
+				}
+				value = mn;
+				work.pop_back();
+				break;
+			}
+			}
+		}
+	}
+}
+
+static const char* AST_NAMES[] = {
+	"program", "assign", "if",
+	"function", "for", "while",
+	"return", "break", "continue",
+	"bool", "logic", "cmp", "add", "multi",
+	"unary", "post", "invoke", "call", "index",
+	"list", "dict", "elements", "mapping",
+	"id", "string", "int", "float"
+};
+
+const char* ASTName(ASTType type)
+{
+	return AST_NAMES[type];
+}
+
+const char* OperatorText(TokenType type)
+{
+#define OPERATOR_CASE(s, t) case t: return s;
+	switch(type)
+	{
+	OPERATOR_LIST(OPERATOR_CASE)
+	default: return "?";
+	}
+#undef OPERATOR_CASE
+}
+
+static void DumpNode(ostream& os, const SymbolTable& symbols, const ASTNode* node, int depth);
+
+static void DumpList(ostream& os, const SymbolTable& symbols, const ParamList& list, int depth)
+{
+	for (const NodeLink* l = list.GetHead(); l; l = l->next)
+		DumpNode(os, symbols, l->node, depth);
+}
+
+static void DumpNode(ostream& os, const SymbolTable& symbols, const ASTNode* node, int depth)
+{
+	if (!node)
+		return;
+	os << string(depth * 2, ' ') << ASTName(node->GetType());
+
+	switch(node->GetType())
+	{
+	case AST_PROGRAM:
+		os << endl;
+		DumpList(os, symbols, ((const ProgramNode*)node)->GetStatements(), depth + 1);
+		break;
+	case AST_ID:
+		os << ' ' << symbols.GetName(((const IdNode*)node)->GetSymbol()) << endl;
+		break;
+	case AST_STRING:
+		os << " \"" << ((const StringNode*)node)->GetText() << '\"' << endl;
+		break;
+	case AST_INT:
+		os << ' ' << ((const IntNode*)node)->GetValue() << endl;
+		break;
+	case AST_FLOAT:
+		os << ' ' << ((const FloatNode*)node)->GetValue() << endl;
+		break;
+	case AST_ELEMENTS:
+		os << endl;
+		DumpList(os, symbols, ((const ElementsNode*)node)->GetElements(), depth + 1);
+		break;
+	case AST_MAPPING:
+	{
+		const MappingNode* mn = (const MappingNode*)node;
+		os << endl;
+		const NodeLink* v = mn->GetValues().GetHead();
+		for (const NodeLink* k = mn->GetKeys().GetHead(); k; k = k->next, v = v->next)
+		{
+			DumpNode(os, symbols, k->node, depth + 1);
+			DumpNode(os, symbols, v->node, depth + 2);
+		}
+		break;
+	}
+	case AST_IF:
+	{
+		const IfNode* in = (const IfNode*)node;
+		os << endl;
+		DumpNode(os, symbols, in->GetCondition(), depth + 1);
+		DumpList(os, symbols, in->GetStatements(), depth + 1);
+		if (in->GetElseStatements().GetSize() > 0)
+		{
+			os << string(depth * 2, ' ') << "else" << endl;
+			DumpList(os, symbols, in->GetElseStatements(), depth + 1);
+		}
+		break;
+	}
+	case AST_FUNCTION:
+	{
+		const FunctionNode* fn = (const FunctionNode*)node;
+		os << endl;
+		DumpNode(os, symbols, fn->GetFunction(), depth + 1);
+		DumpNode(os, symbols, fn->GetParam(), depth + 1);
+		DumpList(os, symbols, fn->GetStatements(), depth + 1);
+		break;
+	}
+	case AST_FOR:
+	{
+		const ForNode* fn = (const ForNode*)node;
+		os << endl;
+		DumpNode(os, symbols, fn->GetIterator(), depth + 1);
+		DumpNode(os, symbols, fn->GetIterList(), depth + 1);
+		DumpList(os, symbols, fn->GetStatements(), depth + 1);
+		break;
+	}
+	case AST_WHILE:
+	{
+		const WhileNode* wn = (const WhileNode*)node;
+		os << endl;
+		DumpNode(os, symbols, wn->GetCondition(), depth + 1);
+		DumpList(os, symbols, wn->GetStatements(), depth + 1);
+		break;
+	}
+	case AST_RETURN:
+		os << endl;
+		DumpNode(os, symbols, ((const ReturnNode*)node)->GetReturn(), depth + 1);
+		break;
+	case AST_BREAK:
+	case AST_CONTINUE:
+		os << endl;
+		break;
+	case AST_ASSIGN:
+	case AST_BOOL:
+	case AST_LOGIC:
+	case AST_CMP:
+	case AST_ADD:
+	case AST_MULTI:
+	{
+		const BinaryNode* bn = (const BinaryNode*)node;
+		os << ' ' << OperatorText(bn->GetOperator()) << endl;
+		DumpNode(os, symbols, bn->GetLeft(), depth + 1);
+		DumpNode(os, symbols, bn->GetRight(), depth + 1);
+		break;
+	}
+	case AST_UNARY:
+	case AST_POST:
+	{
+		const UnaryNode* un = (const UnaryNode*)node;
+		os << ' ' << OperatorText(un->GetOperator()) << endl;
+		DumpNode(os, symbols, un->GetParam(), depth + 1);
+		break;
+	}
+	case AST_INVOKE:
+	{
+		const InvokeNode* in = (const InvokeNode*)node;
+		os << endl;
+		DumpNode(os, symbols, in->GetInstance(), depth + 1);
+		DumpNode(os, symbols, in->GetAttr(), depth + 1);
+		break;
+	}
+	case AST_CALL:
+	{
+		const CallNode* cn = (const CallNode*)node;
+		os << endl;
+		DumpNode(os, symbols, cn->GetFunction(), depth + 1);
+		DumpNode(os, symbols, cn->GetParams(), depth + 1);
+		break;
+	}
+	case AST_INDEX:
+	{
+		const IndexNode* in = (const IndexNode*)node;
+		os << endl;
+		DumpNode(os, symbols, in->GetSource(), depth + 1);
+		DumpNode(os, symbols, in->GetIndex(), depth + 1);
+		break;
+	}
+	case AST_LIST:
+		os << endl;
+		DumpNode(os, symbols, ((const ListNode*)node)->GetElements(), depth + 1);
+		break;
+	case AST_DICT:
+		os << endl;
+		DumpNode(os, symbols, ((const DictNode*)node)->GetMapping(), depth + 1);
+		break;
+	}
+}
+
+void Parser::Dump(ostream& os)
+{
+	DumpNode(os, lexer.GetSymbols(), root, 0);
+}
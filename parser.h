@@ -2,10 +2,17 @@
 #define _PARSER_H_
 
 #include <string>
-#include <list>
+#include <string_view>
+#include <vector>
 #include <exception>
+#include <iostream>
+#include "lexer.h"
+#include "arena.h"
 using namespace std;
 
+class ThreadPool;
+class Parser;
+
 class ParseException: public exception
 {
 private:
@@ -17,109 +24,609 @@ public:
 	ParseException(const string& msg) : err_msg(msg)
 	{}
 
-	virtual const string& what() const throw()
+	virtual const char* what() const throw()
 	{
-		return err_msg;
+		return err_msg.c_str();
 	}
 };
 
-class Lexer;
-class ASTNode;
-
-typedef list<ASTNode*> ParamList;
+struct Diagnostic
+{
+	unsigned int line;
+	unsigned int column;
+	string message;
+};
 
-enum ASTType = {
-	AST_STATEMENT, AST_ASSIGN, AST_IF,
-	AST_FUNCTION, AST_FOR, AST_LOOP,
-	AST_WHILE, AST_RETURN, AST_BREAK,
-	AST_CONTINUE, AST_PASS,
-	AST_EXPR, AST_BOOL, AST_LOGIC, AST_CMP,
-	AST_ADD, AST_UNARY, AST_POST,
-	AST_UNARYOP, AST_PRIMARY, AST_VAR,
+enum ASTType {
+	AST_PROGRAM = 0, AST_ASSIGN, AST_IF,
+	AST_FUNCTION, AST_FOR, AST_WHILE,
+	AST_RETURN, AST_BREAK, AST_CONTINUE,
+	AST_BOOL, AST_LOGIC, AST_CMP, AST_ADD, AST_MULTI,
+	AST_UNARY, AST_POST, AST_INVOKE, AST_CALL, AST_INDEX,
 	AST_LIST, AST_DICT, AST_ELEMENTS, AST_MAPPING,
-	AST_VALUE, AST_ID, AST_PROGRAM
+	AST_ID, AST_STRING, AST_INT, AST_FLOAT
 };
 
+const char* ASTName(ASTType type);
+const char* OperatorText(TokenType type);
+
+// All nodes live in the parser's arena and are released with it; none of
+// them has a destructor to run.
 class ASTNode
 {
 private:
 	ASTType type;
-	int line;
+	unsigned int offset;
 
 public:
-	ASTNode(ASTType t, int l) : type(t), line(l) {};
-	virtual ~ASTNode() {};
+	ASTNode(ASTType t, unsigned int o) : type(t), offset(o) {};
+
+	ASTType GetType() const { return type; };
+	unsigned int GetOffset() const { return offset; };
+	void Shift(int delta) { offset += delta; };
+};
 
-	bool MatchToken(Token& token, TokenType type);
-	ASTType GetType() { return type; };
-	int GetLine() { return line; };
+struct NodeLink
+{
+	ASTNode* node;
+	NodeLink* next;
+};
+
+class ParamList
+{
+private:
+	NodeLink* head;
+	NodeLink* tail;
+	unsigned int size;
+
+public:
+	ParamList() : head(NULL), tail(NULL), size(0) {};
+
+	void Append(Arena& arena, ASTNode* node)
+	{
+		NodeLink* link = arena.New<NodeLink>();
+		link->node = node;
+		link->next = NULL;
+		if (tail)
+			tail->next = link;
+		else
+			head = link;
+		tail = link;
+		++size;
+	};
+	// Swaps the removed links after prev (from the head if prev is NULL)
+	// for other's; stop is the link that followed them.
+	void Replace(NodeLink* prev, NodeLink* stop, unsigned int removed, const ParamList& other)
+	{
+		NodeLink* first = (other.head ? other.head : stop);
+		if (prev)
+			prev->next = first;
+		else
+			head = first;
+		if (other.tail)
+			other.tail->next = stop;
+		if (!stop)
+			tail = (other.tail ? other.tail : prev);
+		size = size - removed + other.size;
+	};
+	NodeLink* GetHead() { return head; };
+	const NodeLink* GetHead() const { return head; };
+	unsigned int GetSize() const { return size; };
 };
 
 class ProgramNode: public ASTNode
+{
+	friend class Parser;
+
+private:
+	ParamList statements;
+
+public:
+	ProgramNode() : ASTNode(AST_PROGRAM, 0)
+	{}
+
+	void AddStatement(Arena& arena, ASTNode* node) { statements.Append(arena, node); };
+	const ParamList& GetStatements() const { return statements; };
+};
+
+class IdNode: public ASTNode
+{
+private:
+	unsigned int symbol;
+
+public:
+	IdNode(unsigned int o, unsigned int s) : ASTNode(AST_ID, o), symbol(s)
+	{}
+
+	unsigned int GetSymbol() const { return symbol; };
+};
+
+class StringNode: public ASTNode
+{
+private:
+	string_view text;
+
+public:
+	StringNode(unsigned int o, string_view s) : ASTNode(AST_STRING, o), text(s)
+	{}
+
+	string_view GetText() const { return text; };
+};
+
+class IntNode: public ASTNode
+{
+private:
+	long long value;
+
+public:
+	IntNode(unsigned int o, long long v) : ASTNode(AST_INT, o), value(v)
+	{}
+
+	long long GetValue() const { return value; };
+};
+
+class FloatNode: public ASTNode
+{
+private:
+	double value;
+
+public:
+	FloatNode(unsigned int o, double v) : ASTNode(AST_FLOAT, o), value(v)
+	{}
+
+	double GetValue() const { return value; };
+};
+
+class ElementsNode: public ASTNode
 {
 private:
+	ParamList elements;
+
+public:
+	ElementsNode(unsigned int o) : ASTNode(AST_ELEMENTS, o)
+	{}
+
+	void AddElement(Arena& arena, ASTNode* node) { elements.Append(arena, node); };
+	const ParamList& GetElements() const { return elements; };
+};
+
+class MappingNode: public ASTNode
+{
+private:
+	ParamList keys;
+	ParamList values;
+
+public:
+	MappingNode(unsigned int o) : ASTNode(AST_MAPPING, o)
+	{}
+
+	void AddMapping(Arena& arena, ASTNode* key, ASTNode* value)
+	{
+		keys.Append(arena, key);
+		values.Append(arena, value);
+	};
+	const ParamList& GetKeys() const { return keys; };
+	const ParamList& GetValues() const { return values; };
+};
+
+class IfNode: public ASTNode
+{
+	friend class Parser;
+
+private:
+	ASTNode* condition;
 	ParamList statements;
+	ParamList else_statements;
 
 public:
-	ProgramNode() : ASTNode(ASTType::AST_PROGRAM, 0)
+	IfNode(unsigned int o) : ASTNode(AST_IF, o), condition(NULL)
 	{}
-	~ProgramNode();
 
-	void AddStatement(ASTNode* node) { statements.push_back(node); };
+	void SetCondition(ASTNode* node) { condition = node; };
+	void AddStatement(Arena& arena, ASTNode* node) { statements.Append(arena, node); };
+	void AddElseStatement(Arena& arena, ASTNode* node) { else_statements.Append(arena, node); };
+	ASTNode* GetCondition() const { return condition; };
+	const ParamList& GetStatements() const { return statements; };
+	const ParamList& GetElseStatements() const { return else_statements; };
 };
 
-class StateNode: public ASTNode
+// A lazily parsed function keeps its parser, the first token of its body
+// and how deeply the body is nested until the statements are first asked
+// for.
+class FunctionNode: public ASTNode
 {
+	friend class Parser;
+
 private:
+	IdNode* function;
+	ElementsNode* params;
 	ParamList statements;
+	Parser* parser;
+	TokenIterator body;
+	unsigned int depth;
 
 public:
-	StateNode(int l) : ASTNode(ASTType::AST_STATEMENT, l)
+	FunctionNode(unsigned int o)
+		: ASTNode(AST_FUNCTION, o), function(NULL), params(NULL), parser(NULL), body(0), depth(0)
 	{}
-	~ProgramNode();
 
-	
+	void SetFunction(IdNode* node) { function = node; };
+	void SetParam(ElementsNode* node) { params = node; };
+	void SetBody(Parser* p, TokenIterator first, unsigned int d)
+	{
+		parser = p;
+		body = first;
+		depth = d;
+	};
+	void AddStatement(Arena& arena, ASTNode* node) { statements.Append(arena, node); };
+	IdNode* GetFunction() const { return function; };
+	ElementsNode* GetParam() const { return params; };
+	bool IsParsed() const { return parser == NULL; };
+	TokenIterator GetBody() const { return body; };
+	const ParamList& GetStatements() const;
+};
+
+class ForNode: public ASTNode
+{
+	friend class Parser;
+
+private:
+	IdNode* iterator;
+	ASTNode* iter_list;
+	ParamList statements;
+
+public:
+	ForNode(unsigned int o) : ASTNode(AST_FOR, o), iterator(NULL), iter_list(NULL)
+	{}
+
+	void SetIterator(IdNode* node) { iterator = node; };
+	void SetIterList(ASTNode* node) { iter_list = node; };
+	void AddStatement(Arena& arena, ASTNode* node) { statements.Append(arena, node); };
+	IdNode* GetIterator() const { return iterator; };
+	ASTNode* GetIterList() const { return iter_list; };
+	const ParamList& GetStatements() const { return statements; };
+};
+
+class WhileNode: public ASTNode
+{
+	friend class Parser;
+
+private:
+	ASTNode* condition;
+	ParamList statements;
+
+public:
+	WhileNode(unsigned int o) : ASTNode(AST_WHILE, o), condition(NULL)
+	{}
+
+	void SetCondition(ASTNode* node) { condition = node; };
+	void AddStatement(Arena& arena, ASTNode* node) { statements.Append(arena, node); };
+	ASTNode* GetCondition() const { return condition; };
+	const ParamList& GetStatements() const { return statements; };
+};
+
+class ReturnNode: public ASTNode
+{
+private:
+	ASTNode* value;
+
+public:
+	ReturnNode(unsigned int o) : ASTNode(AST_RETURN, o), value(NULL)
+	{}
+
+	void SetReturn(ASTNode* node) { value = node; };
+	ASTNode* GetReturn() const { return value; };
+};
+
+class BreakNode: public ASTNode
+{
+public:
+	BreakNode(unsigned int o) : ASTNode(AST_BREAK, o)
+	{}
+};
+
+class ContinueNode: public ASTNode
+{
+public:
+	ContinueNode(unsigned int o) : ASTNode(AST_CONTINUE, o)
+	{}
+};
+
+class BinaryNode: public ASTNode
+{
+private:
+	TokenType op;
+	ASTNode* left;
+	ASTNode* right;
+
+public:
+	BinaryNode(ASTType t, TokenType o, unsigned int off)
+		: ASTNode(t, off), op(o), left(NULL), right(NULL)
+	{}
+
+	void SetLeft(ASTNode* node) { left = node; };
+	void SetRight(ASTNode* node) { right = node; };
+	TokenType GetOperator() const { return op; };
+	ASTNode* GetLeft() const { return left; };
+	ASTNode* GetRight() const { return right; };
+};
+
+class AssignNode: public BinaryNode
+{
+public:
+	AssignNode(TokenType o, unsigned int off) : BinaryNode(AST_ASSIGN, o, off)
+	{}
+};
+
+class BoolNode: public BinaryNode
+{
+public:
+	BoolNode(TokenType o, unsigned int off) : BinaryNode(AST_BOOL, o, off)
+	{}
+};
+
+class LogicNode: public BinaryNode
+{
+public:
+	LogicNode(TokenType o, unsigned int off) : BinaryNode(AST_LOGIC, o, off)
+	{}
+};
+
+class CompareNode: public BinaryNode
+{
+public:
+	CompareNode(TokenType o, unsigned int off) : BinaryNode(AST_CMP, o, off)
+	{}
+};
+
+class AddNode: public BinaryNode
+{
+public:
+	AddNode(TokenType o, unsigned int off) : BinaryNode(AST_ADD, o, off)
+	{}
+};
+
+class MultiNode: public BinaryNode
+{
+public:
+	MultiNode(TokenType o, unsigned int off) : BinaryNode(AST_MULTI, o, off)
+	{}
+};
+
+class UnaryNode: public ASTNode
+{
+private:
+	TokenType op;
+	ASTNode* param;
+
+public:
+	UnaryNode(ASTType t, TokenType o, unsigned int off) : ASTNode(t, off), op(o), param(NULL)
+	{}
+
+	void SetParam(ASTNode* node) { param = node; };
+	TokenType GetOperator() const { return op; };
+	ASTNode* GetParam() const { return param; };
+};
+
+class PreUnaryNode: public UnaryNode
+{
+public:
+	PreUnaryNode(TokenType o, unsigned int off) : UnaryNode(AST_UNARY, o, off)
+	{}
+};
+
+class PostUnaryNode: public UnaryNode
+{
+public:
+	PostUnaryNode(TokenType o, unsigned int off) : UnaryNode(AST_POST, o, off)
+	{}
+};
+
+class InvokeNode: public ASTNode
+{
+private:
+	ASTNode* instance;
+	IdNode* attr;
+
+public:
+	InvokeNode(unsigned int o) : ASTNode(AST_INVOKE, o), instance(NULL), attr(NULL)
+	{}
+
+	void SetInstance(ASTNode* node) { instance = node; };
+	void SetAttr(IdNode* node) { attr = node; };
+	ASTNode* GetInstance() const { return instance; };
+	IdNode* GetAttr() const { return attr; };
+};
+
+class CallNode: public ASTNode
+{
+private:
+	ASTNode* function;
+	ElementsNode* params;
+
+public:
+	CallNode(unsigned int o) : ASTNode(AST_CALL, o), function(NULL), params(NULL)
+	{}
+
+	void SetFunction(ASTNode* node) { function = node; };
+	void SetParams(ElementsNode* node) { params = node; };
+	ASTNode* GetFunction() const { return function; };
+	ElementsNode* GetParams() const { return params; };
+};
+
+class IndexNode: public ASTNode
+{
+private:
+	ASTNode* source;
+	ASTNode* index;
+
+public:
+	IndexNode(unsigned int o) : ASTNode(AST_INDEX, o), source(NULL), index(NULL)
+	{}
+
+	void SetSource(ASTNode* node) { source = node; };
+	void SetIndex(ASTNode* node) { index = node; };
+	ASTNode* GetSource() const { return source; };
+	ASTNode* GetIndex() const { return index; };
+};
+
+class ListNode: public ASTNode
+{
+private:
+	ElementsNode* elements;
+
+public:
+	ListNode(unsigned int o) : ASTNode(AST_LIST, o), elements(NULL)
+	{}
+
+	void SetElements(ElementsNode* node) { elements = node; };
+	ElementsNode* GetElements() const { return elements; };
+};
+
+class DictNode: public ASTNode
+{
+private:
+	MappingNode* mapping;
+
+public:
+	DictNode(unsigned int o) : ASTNode(AST_DICT, o), mapping(NULL)
+	{}
+
+	void SetMapping(MappingNode* node) { mapping = node; };
+	MappingNode* GetMapping() const { return mapping; };
+};
+
+// A suspended step of the explicit-stack parser, waiting for the node
+// being parsed above it.
+struct ParseFrame
+{
+	unsigned char kind;
+	unsigned char power;
+	unsigned int offset;
+	ASTNode* node;
+	ASTNode* key;
+};
+
+// A block still open in the explicit-stack parser; else_part is set once
+// an if has moved on to its else statements.
+struct BlockFrame
+{
+	ASTNode* node;
+	bool else_part;
 };
 
 class Parser
 {
+	friend class TableParser;
+
 private:
 	Lexer& lexer;
-	ASTNode* root;
+	Arena arena;
+	ProgramNode* root;
+	vector<Diagnostic>* diagnostics;
+	bool locate;
+	bool panic;
+	bool lazy;
+	bool complete;
+	size_t reparsed;
+	bool explicit_stack;
+	bool table_driven;
+	unsigned int depth;
+	unsigned int nesting_limit;
+	vector<ParseFrame> work;
+	vector<BlockFrame> open;
+	ThreadPool* pool;
 
+	TokenType PeekType();
 	bool MatchToken(TokenType type);
 	bool MatchTokenMultiLine(TokenType type);
+	void MustMatch(TokenType type);
+	void Error(const string& expect);
+	void Report(const string& message);
+	bool Nest(bool block);
+	void SkipBrackets();
+	void Synchronize();
+	void EndLine();
+	bool MoreStatements(bool else_close);
+	IdNode* identifier(const char* expect);
+	static bool IsAssignable(const ASTNode* node);
+
+	bool ParseParallel();
+	TokenIterator StatementAt(unsigned int offset);
+	bool ReparseList(ParamList& list, const TokenEdit& change, bool top);
+	bool ReparseBlock(ASTNode* node, const TokenEdit& change);
+	bool ReparseRange(TokenIterator first, TokenIterator last, ParamList& list);
+
+	void SkipBlock();
 
 	ASTNode* statement();
 	ASTNode* assign();
+	ASTNode* blockstat();
+	IfNode* ifhead();
+	FunctionNode* functionhead();
+	ForNode* forhead();
+	WhileNode* whilehead();
 	ASTNode* ifstat();
-	ASTNode* functionstat();
+	ASTNode* functiondef();
 	ASTNode* forloop();
 	ASTNode* whileloop();
+	ASTNode* OpenBlock();
+	void AddToBlock(const BlockFrame& frame, ASTNode* node);
+	ASTNode* stackblock();
 	ASTNode* returnstat();
 	ASTNode* breakstat();
 	ASTNode* continuestat();
-	ASTNode* passstat();
 
-	ASTNode* expr();
-	ASTNode* boolexpr();
-	ASTNode* logicexpr();
-	ASTNode* cmpexpr();
-	ASTNode* addexpr();
+	ASTNode* expr(unsigned int power = 1);
 	ASTNode* unaryexpr();
 	ASTNode* postexpr();
 
-	ASTNode* unaryop();
 	ASTNode* priexpr();
-	ASTNode* var();
-	ASTNode* list();
-	ASTNode* dict();
-	ASTNode* elements();
-	ASTNode* mapping();
-	
+	ASTNode* variable();
+	ElementsNode* elements(TokenType close);
+	MappingNode* mapping();
+	ASTNode* stackexpr(unsigned int power);
+
 public:
-	Parser(Lexer& lex);
-	~Parser();
+	static const TokenIterator PARALLEL_MIN_CHUNK = 1 << 16;
+	static const unsigned int DEFAULT_NESTING_LIMIT = 1000;
+
+	// With a diagnostic sink, errors are collected there and parsing
+	// resumes at the next line; otherwise the first error throws.
+	Parser(Lexer& lex, vector<Diagnostic>* sink = NULL, ThreadPool* tp = NULL);
+
+	// Function bodies are skipped and parsed when first needed. Not
+	// available over a streaming lexer, which cannot go back to them.
+	void SetLazy(bool l) { lazy = l && !lexer.IsStreaming(); };
+	// Blocks, brackets and container literals are parsed on a work stack
+	// on the heap instead of by recursion, so deep nesting costs no C++
+	// stack.
+	void SetExplicitStack(bool e) { explicit_stack = e; };
+	// Blocks and brackets nested deeper than this are reported as an
+	// error and skipped, in either mode.
+	void SetNestingLimit(unsigned int limit) { nesting_limit = limit; };
+	// Parses with the tables generated from grammar.ll instead of these
+	// functions. Function bodies are then parsed straight away and there
+	// is no nesting limit; Reparse and ParseBody still use the functions.
+	void SetTableDriven(bool t) { table_driven = t; };
+	void Parse();
+	void ParseBody(FunctionNode* node);
+	// Brings the tree up to date after Lexer::Edit. Only the statements
+	// around the edit are parsed again, falling back to Parse when the
+	// previous parse had errors or the edit does not stay inside them.
+	// The statements replaced stay in the arena until a full parse
+	// releases it, which is forced once they may make up half of it.
+	void Reparse(const TokenEdit& change);
+	ProgramNode* GetRoot() { return root; };
+	size_t GetMemory() { return arena.GetUsed(); };
+	void Dump(ostream& os);
 };
 
-#endif
\ No newline at end of file
+inline const ParamList& FunctionNode::GetStatements() const
+{
+	if (parser)
+		parser->ParseBody(const_cast<FunctionNode*>(this));
+	return statements;
+}
+
+#endif
@@ -0,0 +1,238 @@
+#include "scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+static inline bool IsBlank(unsigned char c)
+{
+	return (c == ' ' || c == '\t' || c == '\r' || c == '\f');
+}
+
+static inline bool IsIdChar(unsigned char c)
+{
+	return ((unsigned char)((c | 0x20) - 'a') < 26
+		|| (unsigned char)(c - '0') < 10
+		|| c == '_');
+}
+
+static const char* ScalarSkipBlank(const char* p, const char* end)
+{
+	while(p < end && IsBlank(*p))
+		++p;
+	return p;
+}
+
+static const char* ScalarSkipLine(const char* p, const char* end)
+{
+	while(p < end && *p != '\n')
+		++p;
+	return p;
+}
+
+static const char* ScalarSkipId(const char* p, const char* end)
+{
+	while(p < end && IsIdChar(*p))
+		++p;
+	return p;
+}
+
+static const char* ScalarSkipString(const char* p, const char* end, char quote)
+{
+	while(p < end && *p != quote && *p != '\n')
+		++p;
+	return p;
+}
+
+#ifdef SCAN_X86
+
+// Bytes >= 0x80 compare as negative, so signed range tests below never
+// accept them.
+__attribute__((target("sse2")))
+static inline __m128i Sse2InRange(__m128i v, char lo, char hi)
+{
+	return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+		_mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+
+__attribute__((target("sse2")))
+static const char* Sse2SkipBlank(const char* p, const char* end)
+{
+	while(p + 16 <= end)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+		__m128i m = _mm_or_si128(
+			_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+				_mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+			_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')),
+				_mm_cmpeq_epi8(v, _mm_set1_epi8('\f'))));
+		unsigned int stop = ~_mm_movemask_epi8(m) & 0xFFFF;
+		if (stop)
+			return p + __builtin_ctz(stop);
+		p += 16;
+	}
+	return ScalarSkipBlank(p, end);
+}
+
+__attribute__((target("sse2")))
+static const char* Sse2SkipLine(const char* p, const char* end)
+{
+	while(p + 16 <= end)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+		unsigned int stop = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+		if (stop)
+			return p + __builtin_ctz(stop);
+		p += 16;
+	}
+	return ScalarSkipLine(p, end);
+}
+
+__attribute__((target("sse2")))
+static const char* Sse2SkipId(const char* p, const char* end)
+{
+	while(p + 16 <= end)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+		__m128i m = _mm_or_si128(
+			_mm_or_si128(Sse2InRange(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z'),
+				Sse2InRange(v, '0', '9')),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+		unsigned int stop = ~_mm_movemask_epi8(m) & 0xFFFF;
+		if (stop)
+			return p + __builtin_ctz(stop);
+		p += 16;
+	}
+	return ScalarSkipId(p, end);
+}
+
+__attribute__((target("sse2")))
+static const char* Sse2SkipString(const char* p, const char* end, char quote)
+{
+	while(p + 16 <= end)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+		__m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(quote)),
+			_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+		unsigned int stop = _mm_movemask_epi8(m);
+		if (stop)
+			return p + __builtin_ctz(stop);
+		p += 16;
+	}
+	return ScalarSkipString(p, end, quote);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i Avx2InRange(__m256i v, char lo, char hi)
+{
+	return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+		_mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+__attribute__((target("avx2")))
+static const char* Avx2SkipBlank(const char* p, const char* end)
+{
+	while(p + 32 <= end)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)p);
+		__m256i m = _mm256_or_si256(
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+			_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')),
+				_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\f'))));
+		unsigned int stop = ~(unsigned int)_mm256_movemask_epi8(m);
+		if (stop)
+			return p + __builtin_ctz(stop);
+		p += 32;
+	}
+	return Sse2SkipBlank(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* Avx2SkipLine(const char* p, const char* end)
+{
+	while(p + 32 <= end)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)p);
+		unsigned int stop = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+		if (stop)
+			return p + __builtin_ctz(stop);
+		p += 32;
+	}
+	return Sse2SkipLine(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* Avx2SkipId(const char* p, const char* end)
+{
+	while(p + 32 <= end)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)p);
+		__m256i m = _mm256_or_si256(
+			_mm256_or_si256(Avx2InRange(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z'),
+				Avx2InRange(v, '0', '9')),
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+		unsigned int stop = ~(unsigned int)_mm256_movemask_epi8(m);
+		if (stop)
+			return p + __builtin_ctz(stop);
+		p += 32;
+	}
+	return Sse2SkipId(p, end);
+}
+
+__attribute__((target("avx2")))
+static const char* Avx2SkipString(const char* p, const char* end, char quote)
+{
+	while(p + 32 <= end)
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i*)p);
+		__m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(quote)),
+			_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+		unsigned int stop = _mm256_movemask_epi8(m);
+		if (stop)
+			return p + __builtin_ctz(stop);
+		p += 32;
+	}
+	return Sse2SkipString(p, end, quote);
+}
+
+#endif
+
+static const ScanKernels KERNELS[] = {
+	{ SCAN_SCALAR, ScalarSkipBlank, ScalarSkipLine, ScalarSkipId, ScalarSkipString },
+#ifdef SCAN_X86
+	{ SCAN_SSE2, Sse2SkipBlank, Sse2SkipLine, Sse2SkipId, Sse2SkipString },
+	{ SCAN_AVX2, Avx2SkipBlank, Avx2SkipLine, Avx2SkipId, Avx2SkipString },
+#endif
+};
+
+static ScanLevel DetectScanLevel()
+{
+#ifdef SCAN_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return SCAN_AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return SCAN_SSE2;
+#endif
+	return SCAN_SCALAR;
+}
+
+ScanLevel GetScanLevel()
+{
+	static const ScanLevel level = DetectScanLevel();
+	return level;
+}
+
+const ScanKernels& GetScanKernels()
+{
+	return KERNELS[GetScanLevel()];
+}
+
+const ScanKernels& GetScanKernels(ScanLevel level)
+{
+	if (level > GetScanLevel())
+		level = GetScanLevel();
+	return KERNELS[level];
+}
@@ -0,0 +1,23 @@
+#ifndef _SCAN_H_
+#define _SCAN_H_
+
+enum ScanLevel {
+	SCAN_SCALAR = 0, SCAN_SSE2, SCAN_AVX2
+};
+
+// Each kernel returns the first position in [p, end) that stops the run,
+// or end when the whole range belongs to it.
+struct ScanKernels
+{
+	ScanLevel level;
+	const char* (*skip_blank)(const char* p, const char* end);
+	const char* (*skip_line)(const char* p, const char* end);
+	const char* (*skip_id)(const char* p, const char* end);
+	const char* (*skip_string)(const char* p, const char* end, char quote);
+};
+
+ScanLevel GetScanLevel();
+const ScanKernels& GetScanKernels();
+const ScanKernels& GetScanKernels(ScanLevel level);
+
+#endif
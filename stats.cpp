@@ -0,0 +1,157 @@
+#include "stats.h"
+#include "alloc_counter.h"
+#include "lexer.h"
+#include "parser.h"
+#include "flat_ast.h"
+#include <chrono>
+#include <iomanip>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Running totals; Begin and End turn them into what one phase used.
+PhaseStats Stats::Sample()
+{
+	PhaseStats s;
+	s.name = NULL;
+	s.wall_ms = chrono::duration<double, milli>(
+		chrono::steady_clock::now().time_since_epoch()).count();
+	s.allocs = GetAllocCount();
+	s.alloc_bytes = GetAllocBytes();
+#ifdef _WIN32
+	FILETIME created, exited, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user);
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+	s.cpu_ms = (k.QuadPart + u.QuadPart) / 10000.0;
+	PROCESS_MEMORY_COUNTERS pmc;
+	GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc));
+	s.peak_rss_kb = pmc.PeakWorkingSetSize / 1024;
+#else
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	s.cpu_ms = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000.0
+		+ (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000.0;
+#ifdef __APPLE__
+	s.peak_rss_kb = ru.ru_maxrss / 1024;
+#else
+	s.peak_rss_kb = ru.ru_maxrss;
+#endif
+#endif
+	return s;
+}
+
+void Stats::Begin(const char* phase)
+{
+	start = Sample();
+	start.name = phase;
+}
+
+void Stats::End()
+{
+	PhaseStats now = Sample();
+	PhaseStats p;
+	p.name = start.name;
+	p.wall_ms = now.wall_ms - start.wall_ms;
+	p.cpu_ms = now.cpu_ms - start.cpu_ms;
+	p.allocs = now.allocs - start.allocs;
+	p.alloc_bytes = now.alloc_bytes - start.alloc_bytes;
+	p.peak_rss_kb = now.peak_rss_kb;
+	phases.push_back(p);
+}
+
+void Stats::CountTokens(const TokenBuffer& buffer)
+{
+	tokens.assign(TOKEN_UNKNOWN + 1, 0);
+	for (TokenIterator i = buffer.GetFirst(), end = buffer.GetSize(); i < end; ++i)
+		++tokens[buffer.GetType(i)];
+}
+
+void Stats::CountNodes(const FlatAST& ast)
+{
+	nodes.assign(AST_FLOAT + 1, 0);
+	for (NodeIndex n = 0; n < ast.GetSize(); ++n)
+		++nodes[ast.GetKind(n)];
+}
+
+void Stats::Print(ostream& os) const
+{
+	ios::fmtflags flags = os.flags();
+	streamsize precision = os.precision();
+	os << left << setw(8) << "phase" << right << setw(12) << "wall ms" << setw(12) << "cpu ms"
+		<< setw(12) << "allocs" << setw(14) << "alloc bytes" << setw(14) << "peak rss kb" << endl;
+	os << fixed << setprecision(3);
+	for (const PhaseStats& p : phases)
+	{
+		os << left << setw(8) << p.name << right << setw(12) << p.wall_ms << setw(12) << p.cpu_ms
+			<< setw(12) << p.allocs << setw(14) << p.alloc_bytes << setw(14) << p.peak_rss_kb << endl;
+	}
+	os.flags(flags);
+	os.precision(precision);
+
+	if (!tokens.empty())
+	{
+		os << "tokens:";
+		for (unsigned int t = 0; t < tokens.size(); ++t)
+		{
+			if (tokens[t])
+				os << ' ' << TokenName((TokenType)t) << '=' << tokens[t];
+		}
+		os << endl;
+	}
+	if (!nodes.empty())
+	{
+		os << "nodes:";
+		for (unsigned int n = 0; n < nodes.size(); ++n)
+		{
+			if (nodes[n])
+				os << ' ' << ASTName((ASTType)n) << '=' << nodes[n];
+		}
+		os << endl;
+	}
+}
+
+// No token or node name holds a quote or a backslash, so the names go
+// into the JSON keys as they are.
+void Stats::PrintJSON(ostream& os) const
+{
+	ios::fmtflags flags = os.flags();
+	streamsize precision = os.precision();
+	os << fixed << setprecision(3);
+	os << "{\"phases\":[";
+	for (size_t i = 0; i < phases.size(); ++i)
+	{
+		const PhaseStats& p = phases[i];
+		os << (i ? "," : "") << "{\"name\":\"" << p.name << "\",\"wall_ms\":" << p.wall_ms
+			<< ",\"cpu_ms\":" << p.cpu_ms << ",\"allocs\":" << p.allocs
+			<< ",\"alloc_bytes\":" << p.alloc_bytes << ",\"peak_rss_kb\":" << p.peak_rss_kb << "}";
+	}
+	os << "],\"tokens\":{";
+	bool first = true;
+	for (unsigned int t = 0; t < tokens.size(); ++t)
+	{
+		if (!tokens[t])
+			continue;
+		os << (first ? "" : ",") << '"' << TokenName((TokenType)t) << "\":" << tokens[t];
+		first = false;
+	}
+	os << "},\"nodes\":{";
+	first = true;
+	for (unsigned int n = 0; n < nodes.size(); ++n)
+	{
+		if (!nodes[n])
+			continue;
+		os << (first ? "" : ",") << '"' << ASTName((ASTType)n) << "\":" << nodes[n];
+		first = false;
+	}
+	os << "}}" << endl;
+	os.flags(flags);
+	os.precision(precision);
+}
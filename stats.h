@@ -0,0 +1,48 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <string>
+#include <vector>
+#include <iostream>
+using namespace std;
+
+class TokenBuffer;
+class FlatAST;
+
+struct PhaseStats
+{
+	const char* name;
+	double wall_ms;
+	double cpu_ms;
+	unsigned long long allocs;
+	unsigned long long alloc_bytes;
+	size_t peak_rss_kb;
+};
+
+// Wall and CPU time, allocations and peak RSS around each phase of a run,
+// plus token and node counts by type. Taking the samples costs a clock
+// read and a getrusage per phase, so it is always done; the counts by
+// type are a pass over the tokens or nodes, made only when asked for.
+class Stats
+{
+private:
+	vector<PhaseStats> phases;
+	PhaseStats start;
+	vector<unsigned long long> tokens;
+	vector<unsigned long long> nodes;
+
+	static PhaseStats Sample();
+
+public:
+	Stats() {};
+
+	void Begin(const char* phase);
+	void End();
+	void CountTokens(const TokenBuffer& buffer);
+	void CountNodes(const FlatAST& ast);
+
+	void Print(ostream& os) const;
+	void PrintJSON(ostream& os) const;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#include "symbol_table.h"
+#include <cstring>
+
+static unsigned int HashName(const char* s, size_t len)
+{
+	unsigned long long h = len * 0x9E3779B97F4A7C15ull;
+	while(len >= 8)
+	{
+		unsigned long long w;
+		memcpy(&w, s, 8);
+		h = (h ^ w) * 0xFF51AFD7ED558CCDull;
+		h ^= h >> 32;
+		s += 8;
+		len -= 8;
+	}
+	if (len > 0)
+	{
+		unsigned long long w = 0;
+		memcpy(&w, s, len);
+		h ^= w;
+	}
+	h = (h ^ (h >> 33)) * 0xC4CEB9FE1A85EC53ull;
+	h ^= h >> 33;
+	return (unsigned int)h;
+}
+
+SymbolTable::SymbolTable() : mask(1023)
+{
+	slots.assign(mask + 1, 0);
+	Intern("", 0);
+}
+
+SymbolTable& SymbolTable::Global()
+{
+	static SymbolTable table;
+	return table;
+}
+
+unsigned int SymbolTable::Intern(const char* s, size_t len)
+{
+	unsigned int h = HashName(s, len);
+	unsigned int i = h & mask;
+	while(slots[i] != 0)
+	{
+		unsigned int id = slots[i] - 1;
+		if (hashes[id] == h && names[id].size() == len
+			&& memcmp(names[id].data(), s, len) == 0)
+			return id;
+		i = (i + 1) & mask;
+	}
+
+	unsigned int id = (unsigned int)names.size();
+	names.push_back(string_view(arena.Copy(s, len), len));
+	hashes.push_back(h);
+	slots[i] = id + 1;
+	if (names.size() * 2 > mask)
+		Grow();
+	return id;
+}
+
+void SymbolTable::Grow()
+{
+	mask = mask * 2 + 1;
+	slots.assign(mask + 1, 0);
+	for (unsigned int id = 0; id < names.size(); ++id)
+	{
+		unsigned int i = hashes[id] & mask;
+		while(slots[i] != 0)
+			i = (i + 1) & mask;
+		slots[i] = id + 1;
+	}
+}
@@ -0,0 +1,31 @@
+#ifndef _SYMBOL_TABLE_H_
+#define _SYMBOL_TABLE_H_
+
+#include <string_view>
+#include <vector>
+#include "arena.h"
+using namespace std;
+
+class SymbolTable
+{
+private:
+	Arena arena;
+	vector<string_view> names;
+	vector<unsigned int> hashes;
+	vector<unsigned int> slots;
+	unsigned int mask;
+
+	void Grow();
+
+public:
+	SymbolTable();
+
+	static SymbolTable& Global();
+
+	unsigned int Intern(const char* s, size_t len);
+	unsigned int Intern(string_view s) { return Intern(s.data(), s.size()); };
+	string_view GetName(unsigned int id) const { return names[id]; };
+	unsigned int GetSize() const { return (unsigned int)names.size(); };
+};
+
+#endif
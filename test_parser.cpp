@@ -0,0 +1,209 @@
+#include "lexer.h"
+#include "parser.h"
+#include <sstream>
+
+struct Engine
+{
+	const char* name;
+	bool explicit_stack;
+	bool table_driven;
+};
+
+static const Engine ENGINES[] = {
+	{ "recursive", false, false },
+	{ "explicit", true, false },
+	{ "table", false, true },
+};
+
+static int failures = 0;
+
+static void Fail(const string& test, const string& what)
+{
+	cerr << "FAIL " << test << ": " << what << endl;
+	++failures;
+}
+
+static void Escape(ostream& os, const string& text)
+{
+	for (size_t i = 0; i < text.size(); ++i)
+	{
+		if (text[i] == '\n')
+			os << "\\n";
+		else
+			os << text[i];
+	}
+}
+
+static string Tree(Parser& parser)
+{
+	ostringstream tree;
+	parser.Dump(tree);
+	return tree.str();
+}
+
+// Broken input is parsed with a sink in every engine: each must report an
+// error instead of throwing or reading past the last token, and all the
+// errors and the partial tree must be the ones the recursive parser gives.
+static void TestRecovery(const string& source)
+{
+	ostringstream name;
+	name << "recovery \"";
+	Escape(name, source);
+	name << "\"";
+
+	string first, first_tree;
+	for (size_t e = 0; e < sizeof(ENGINES) / sizeof(ENGINES[0]); ++e)
+	{
+		string test = name.str() + " " + ENGINES[e].name;
+		Lexer lexer(source.data(), source.size());
+		vector<Diagnostic> diags;
+		Parser parser(lexer, &diags);
+		parser.SetExplicitStack(ENGINES[e].explicit_stack);
+		parser.SetTableDriven(ENGINES[e].table_driven);
+		string tree;
+		try
+		{
+			parser.Parse();
+			tree = Tree(parser);
+		}
+		catch(exception& e)
+		{
+			Fail(test, e.what());
+			continue;
+		}
+		if (diags.empty())
+		{
+			Fail(test, "no error reported");
+			continue;
+		}
+		ostringstream diag;
+		for (size_t i = 0; i < diags.size(); ++i)
+			diag << (i ? ", " : "") << diags[i].line << ":" << diags[i].column << " " << diags[i].message;
+		if (e == 0)
+		{
+			first = diag.str();
+			first_tree = tree;
+		}
+		else if (diag.str() != first)
+			Fail(test, "reports " + diag.str() + " instead of " + first);
+		else if (tree != first_tree)
+			Fail(test, "keeps another tree");
+	}
+}
+
+// Reparse after an edit must give the tree a fresh parse of the edited
+// source gives.
+static void TestReparse(const string& source, unsigned int offset, unsigned int length,
+	const string& text)
+{
+	ostringstream name;
+	name << "reparse \"";
+	Escape(name, source);
+	name << "\" at " << offset << " with \"";
+	Escape(name, text);
+	name << "\"";
+
+	Lexer lexer(source.data(), source.size());
+	vector<Diagnostic> diags;
+	Parser parser(lexer, &diags);
+	parser.Parse();
+	TokenEdit change;
+	if (!lexer.Edit(offset, length, text, &change))
+	{
+		Fail(name.str(), "edit failed");
+		return;
+	}
+	diags.clear();
+	parser.Reparse(change);
+
+	string edited(lexer.GetSource());
+	Lexer fresh_lexer(edited.data(), edited.size());
+	vector<Diagnostic> fresh_diags;
+	Parser fresh(fresh_lexer, &fresh_diags);
+	fresh.Parse();
+
+	if (diags.size() != fresh_diags.size())
+		Fail(name.str(), "errors differ from a full parse");
+	else if (Tree(parser) != Tree(fresh))
+		Fail(name.str(), "tree differs from a full parse");
+}
+
+// Lexical errors stay in source order across an edit, and a lexer that
+// streamed its input refuses edits.
+static void TestLexerEdit()
+{
+	string source = "a = 1\nb = 1.\n";
+	Lexer lexer(source.data(), source.size());
+	lexer.Edit(0, 0, "c = 2.\n");
+	const vector<unsigned int>& errors = lexer.GetErrors();
+	if (errors.size() != 2 || errors[0] >= errors[1])
+		Fail("lexer edit", "errors out of source order");
+	lexer.Edit(0, 7, "");
+	if (lexer.GetErrors().size() != 1)
+		Fail("lexer edit", "error of the removed line kept");
+
+	string lines;
+	for (int i = 0; i < 1000; ++i)
+		lines += "x = y\n";
+	istringstream is(lines);
+	Lexer stream(is, 64);
+	for (stream.StartIterate(); !stream.IsEnd(); stream.Next())
+		;
+	if (stream.Edit(0, 0, "z = 1\n"))
+		Fail("lexer edit", "edit accepted after streaming");
+}
+
+int main()
+{
+	// Brackets left open at the end of input.
+	TestRecovery("x = [\n");
+	TestRecovery("x = {\n");
+	TestRecovery("f(\n");
+	TestRecovery("x = [1, 2\n");
+	TestRecovery("x = {1: 2,\n");
+	TestRecovery("def f(\n");
+	TestRecovery("a = f(1, [2, {3: 4\n");
+
+	// Errors inside expressions and statements.
+	TestRecovery("x = 1 +\n");
+	TestRecovery("x = [1 if\n");
+	TestRecovery("f(1 if\n");
+	TestRecovery("x = [1]]\n");
+	TestRecovery("f(a])\n");
+	TestRecovery("x = {1 2}\n");
+	TestRecovery("a b = 1\n");
+	TestRecovery("a = b.\n");
+	TestRecovery("a = b[1 elif\n");
+	TestRecovery("def (a)\nend\n");
+	TestRecovery("for in a\nend\n");
+	TestRecovery("return if\n");
+	TestRecovery("1 = 2\n");
+	TestRecovery("end\n");
+	TestRecovery("if a\nb = 1\n");
+
+	// Errors after the first one, and the partial trees kept.
+	TestRecovery("a b\n");
+	TestRecovery("1 = 2\nc = 3\n");
+	TestRecovery("if x\na b\nc = 1\nend\n");
+	TestRecovery("if x\na elif y\nb = 1\nend\n");
+	TestRecovery("def f(+)\nend\nx = [)\n");
+	TestRecovery("while x y\n\tz = 1\nend\nend\n");
+
+	// A comment swallows its newline, joining the edited line to the next.
+	TestReparse("a = 1\nb = 2\n", 4, 0, "#c");
+	TestReparse("a = 1\nb = 2\nc = 3\n", 5, 1, "");
+	TestReparse("if a\n\tb = 1\n\tc = 2\nend\n", 11, 0, "#c");
+	TestReparse("a = 1\n(b).c = 2\n", 4, 0, "#c");
+	TestReparse("a = 1\nb = 2\n", 6, 0, "c = 3\n");
+	TestReparse("def f(x)\n\treturn x\nend\ny = 2\n", 18, 0, " + 1");
+
+	TestLexerEdit();
+
+	if (failures)
+	{
+		cerr << failures << " failed" << endl;
+		return -1;
+	}
+	cout << "all passed" << endl;
+	return 0;
+}
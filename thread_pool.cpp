@@ -0,0 +1,62 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned int threads) : pending(0), stop(false)
+{
+	if (threads == 0)
+		threads = thread::hardware_concurrency();
+	if (threads == 0)
+		threads = 1;
+	for (unsigned int i = 0; i < threads; ++i)
+		workers.push_back(thread(&ThreadPool::Work, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		unique_lock<mutex> guard(lock);
+		stop = true;
+	}
+	ready.notify_all();
+	for (size_t i = 0; i < workers.size(); ++i)
+		workers[i].join();
+}
+
+void ThreadPool::Submit(function<void()> task)
+{
+	{
+		unique_lock<mutex> guard(lock);
+		tasks.push(task);
+		++pending;
+	}
+	ready.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+	unique_lock<mutex> guard(lock);
+	while(pending > 0)
+		done.wait(guard);
+}
+
+void ThreadPool::Work()
+{
+	while(true)
+	{
+		function<void()> task;
+		{
+			unique_lock<mutex> guard(lock);
+			while(!stop && tasks.empty())
+				ready.wait(guard);
+			if (tasks.empty())
+				return;
+			task = tasks.front();
+			tasks.pop();
+		}
+
+		task();
+
+		unique_lock<mutex> guard(lock);
+		if (--pending == 0)
+			done.notify_all();
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef _THREAD_POOL_H_
+#define _THREAD_POOL_H_
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+using namespace std;
+
+class ThreadPool
+{
+private:
+	vector<thread> workers;
+	queue<function<void()> > tasks;
+	mutex lock;
+	condition_variable ready;
+	condition_variable done;
+	unsigned int pending;
+	bool stop;
+
+	void Work();
+
+public:
+	ThreadPool(unsigned int threads = 0);
+	~ThreadPool();
+
+	unsigned int GetSize() { return (unsigned int)workers.size(); };
+	void Submit(function<void()> task);
+	void Wait();
+};
+
+#endif
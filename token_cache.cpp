@@ -0,0 +1,147 @@
+#include "token_cache.h"
+#include "lexer.h"
+#include "mapped_file.h"
+#include "symbol_table.h"
+#include "hash.h"
+
+static const char CACHE_MAGIC[8] = { 'T', 'O', 'K', 'C', 'A', 'C', 'H', 'E' };
+
+// The payload follows the header, widest columns first so every one of
+// them stays aligned: literals, offsets, lengths, values, name ends,
+// types and finally the identifier names back to back.
+struct CacheHeader
+{
+	CacheStamp stamp;
+	unsigned int token_count;
+	unsigned int literal_count;
+	unsigned int symbol_count;
+	unsigned int name_bytes;
+};
+
+static unsigned long long PayloadSize(const CacheHeader& h)
+{
+	return (unsigned long long)h.literal_count * sizeof(TokenLiteral)
+		+ (unsigned long long)h.token_count * (3 * sizeof(unsigned int) + sizeof(TokenType))
+		+ (unsigned long long)h.symbol_count * sizeof(unsigned int)
+		+ h.name_bytes;
+}
+
+TokenCache::TokenCache(const char* cache_path, const char* source, size_t source_size)
+	: path(cache_path), src(source), size(source_size)
+{
+	hash = HashBytes(src, size);
+}
+
+bool TokenCache::Load(TokenBuffer& tokens, SymbolTable& symbols)
+{
+	MappedFile file(path.c_str());
+	if (file.IsFail() || file.GetSize() < sizeof(CacheHeader))
+		return false;
+
+	CacheHeader h;
+	memcpy(&h, file.GetData(), sizeof(h));
+	const char* p = file.GetData() + sizeof(h);
+	if (PayloadSize(h) != file.GetSize() - sizeof(h) || h.token_count == 0
+		|| !CheckStamp(h.stamp, CACHE_MAGIC, VERSION, hash, size, p, PayloadSize(h)))
+		return false;
+
+	unsigned int n = h.token_count;
+	const TokenLiteral* literals = (const TokenLiteral*)p;
+	tokens.literals.assign(literals, literals + h.literal_count);
+	tokens.literal_count = h.literal_count;
+	p += h.literal_count * sizeof(TokenLiteral);
+	const unsigned int* columns = (const unsigned int*)p;
+	tokens.offsets.assign(columns, columns + n);
+	tokens.lengths.assign(columns + n, columns + 2 * n);
+	tokens.values.assign(columns + 2 * n, columns + 3 * n);
+	p += 3 * n * sizeof(unsigned int);
+	const char* name_ends = p;
+	p += h.symbol_count * sizeof(unsigned int);
+	tokens.types.assign((const TokenType*)p, (const TokenType*)p + n);
+	tokens.count = n;
+	p += n;
+
+	bool ok = true;
+	vector<unsigned int> remap(h.symbol_count);
+	unsigned int start = 0;
+	for (unsigned int k = 0; k < h.symbol_count && ok; ++k)
+	{
+		unsigned int end;
+		memcpy(&end, name_ends + k * sizeof(unsigned int), sizeof(end));
+		ok = (end >= start && end <= h.name_bytes);
+		if (ok)
+			remap[k] = symbols.Intern(p + start, end - start);
+		start = end;
+	}
+
+	for (unsigned int i = 0; i < n && ok; ++i)
+	{
+		TokenType type = tokens.types[i];
+		unsigned int value = tokens.values[i];
+		ok = (type < TOKEN_UNKNOWN && tokens.offsets[i] <= size
+			&& tokens.lengths[i] <= size - tokens.offsets[i]);
+		if (type == TOKEN_ID)
+		{
+			ok = ok && value < h.symbol_count;
+			if (ok)
+				tokens.values[i] = remap[value];
+		}
+		else if (type == TOKEN_INT || type == TOKEN_FLOAT)
+		{
+			ok = ok && value < h.literal_count;
+		}
+	}
+	ok = ok && tokens.types[n - 1] == TOKEN_EOL;
+
+	if (!ok)
+	{
+		tokens.Resize(0);
+		tokens.ResizeLiterals(0);
+	}
+	return ok;
+}
+
+bool TokenCache::Save(const TokenBuffer& tokens, const SymbolTable& symbols)
+{
+	unsigned int n = tokens.GetSize();
+	if (tokens.GetFirst() != 0)
+		return false;
+
+	// Symbol ids are only meaningful to this process; store the names the
+	// file uses and number them locally.
+	vector<unsigned int> local(symbols.GetSize(), ~0u);
+	vector<unsigned int> values(tokens.values.begin(), tokens.values.begin() + n);
+	vector<unsigned int> name_ends;
+	string names;
+	for (unsigned int i = 0; i < n; ++i)
+	{
+		if (tokens.types[i] != TOKEN_ID)
+			continue;
+		unsigned int& id = local[values[i]];
+		if (id == ~0u)
+		{
+			id = (unsigned int)name_ends.size();
+			names.append(symbols.GetName(values[i]));
+			name_ends.push_back((unsigned int)names.size());
+		}
+		values[i] = id;
+	}
+
+	CacheHeader h;
+	h.token_count = n;
+	h.literal_count = tokens.GetLiteralCount();
+	h.symbol_count = (unsigned int)name_ends.size();
+	h.name_bytes = (unsigned int)names.size();
+
+	string payload;
+	payload.reserve(PayloadSize(h));
+	payload.append((const char*)tokens.literals.data(), h.literal_count * sizeof(TokenLiteral));
+	payload.append((const char*)tokens.offsets.data(), n * sizeof(unsigned int));
+	payload.append((const char*)tokens.lengths.data(), n * sizeof(unsigned int));
+	payload.append((const char*)values.data(), n * sizeof(unsigned int));
+	payload.append((const char*)name_ends.data(), name_ends.size() * sizeof(unsigned int));
+	payload.append((const char*)tokens.types.data(), n);
+	payload.append(names);
+	StampCache(h.stamp, CACHE_MAGIC, VERSION, hash, size, payload);
+	return SaveCacheFile(path, &h, sizeof(h), payload);
+}
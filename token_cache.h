@@ -0,0 +1,30 @@
+#ifndef _TOKEN_CACHE_H_
+#define _TOKEN_CACHE_H_
+
+#include <string>
+using namespace std;
+
+class TokenBuffer;
+class SymbolTable;
+
+// A lexed token stream saved next to its source. The file is keyed by a
+// hash of the source text, and anything that does not check out (missing,
+// stale, truncated, corrupt) makes Load fail so that the caller lexes.
+class TokenCache
+{
+private:
+	string path;
+	const char* src;
+	size_t size;
+	unsigned long long hash;
+
+public:
+	static const unsigned int VERSION = 1;
+
+	TokenCache(const char* cache_path, const char* source, size_t source_size);
+
+	bool Load(TokenBuffer& tokens, SymbolTable& symbols);
+	bool Save(const TokenBuffer& tokens, const SymbolTable& symbols);
+};
+
+#endif